@@ -25,6 +25,7 @@ SRCS	+=  $(SOC)/armv7_nonsec.c
 SRCS	+=  $(SOC)/psci_board.c
 SRCS	+=  $(SOC)/security.c
 SRCS	+=  $(SOC)/cache_helpers.c
+SRCS	+=  $(SOC)/mmu.c
 
 USE_SPI = $(shell grep -E "^\#define CONFIG_BOOT_SPI" board.h)
 ifneq ($(USE_SPI),)
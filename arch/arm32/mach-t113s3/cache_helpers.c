@@ -1,27 +1,128 @@
 #include <stdint.h>
 #include <barrier.h>
 #include <asm/cache.h>
+#include "config.h"
+
+#define CACHE_LINE_MASK ((uintptr_t)CONFIG_SYS_CACHELINE_SIZE - 1U)
 
 static inline void dcache_clean_invalidate_line_by_mva(uintptr_t addr)
 {
 	__asm__ __volatile__("mcr p15, 0, %0, c7, c14, 1" :: "r"(addr) : "memory");
 }
 
+static inline void dcache_clean_line_by_mva(uintptr_t addr)
+{
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c10, 1" :: "r"(addr) : "memory");
+}
+
+static inline void dcache_invalidate_line_by_mva(uintptr_t addr)
+{
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c6, 1" :: "r"(addr) : "memory");
+}
+
 static inline void icache_invalidate_all_cp15(void)
 {
 	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 0" :: "r"(0u) : "memory");
 }
 
+static inline uint32_t read_clidr(void)
+{
+	uint32_t value;
+
+	__asm__ __volatile__("mrc p15, 1, %0, c0, c0, 1" : "=r"(value));
+	return value;
+}
+
+static inline uint32_t read_ccsidr(uint32_t level)
+{
+	uint32_t value;
+
+	/* Select the data/unified cache at this level, then read its geometry */
+	__asm__ __volatile__("mcr p15, 2, %0, c0, c0, 0" :: "r"(level << 1) : "memory");
+	isb();
+	__asm__ __volatile__("mrc p15, 1, %0, c0, c0, 0" : "=r"(value));
+	return value;
+}
+
+/*
+ * Walk every data/unified cache level up to the level of coherency by set/way.
+ * Same algorithm as the ARMv7-A ARM example (B2.2.7).
+ */
+static void dcache_maintain_all(int invalidate_only)
+{
+	uint32_t clidr = read_clidr();
+	uint32_t loc   = (clidr >> 24) & 0x7;
+	uint32_t level, ccsidr, ways, sets, way, set;
+	uint32_t line_shift, way_shift, setway;
+
+	dmb();
+	for (level = 0; level < loc; level++) {
+		if (((clidr >> (level * 3)) & 0x7) < 2)
+			continue; /* no data cache at this level */
+
+		ccsidr	   = read_ccsidr(level);
+		line_shift = (ccsidr & 0x7) + 4;
+		ways	   = ((ccsidr >> 3) & 0x3ff) + 1;
+		sets	   = ((ccsidr >> 13) & 0x7fff) + 1;
+		way_shift  = (ways > 1) ? __builtin_clz(ways - 1) : 0;
+
+		for (way = 0; way < ways; way++) {
+			for (set = 0; set < sets; set++) {
+				setway = (way << way_shift) | (set << line_shift) | (level << 1);
+				if (invalidate_only)
+					__asm__ __volatile__("mcr p15, 0, %0, c7, c6, 2" :: "r"(setway) : "memory");
+				else
+					__asm__ __volatile__("mcr p15, 0, %0, c7, c14, 2" :: "r"(setway) : "memory");
+			}
+		}
+	}
+
+	/* Restore cache level selection */
+	__asm__ __volatile__("mcr p15, 2, %0, c0, c0, 0" :: "r"(0u) : "memory");
+	dsb();
+	isb();
+}
+
 void flush_dcache_range(unsigned long start, unsigned long stop)
 {
 	uintptr_t addr;
 
-	for (addr = start; addr < stop; addr += 32) {
+	for (addr = start & ~CACHE_LINE_MASK; addr < stop; addr += CONFIG_SYS_CACHELINE_SIZE) {
 		dcache_clean_invalidate_line_by_mva(addr);
 	}
 	dsb();
 }
 
+void clean_dcache_range(unsigned long start, unsigned long stop)
+{
+	uintptr_t addr;
+
+	for (addr = start & ~CACHE_LINE_MASK; addr < stop; addr += CONFIG_SYS_CACHELINE_SIZE) {
+		dcache_clean_line_by_mva(addr);
+	}
+	dsb();
+}
+
+void invalidate_dcache_range(unsigned long start, unsigned long stop)
+{
+	uintptr_t addr;
+
+	for (addr = start & ~CACHE_LINE_MASK; addr < stop; addr += CONFIG_SYS_CACHELINE_SIZE) {
+		dcache_invalidate_line_by_mva(addr);
+	}
+	dsb();
+}
+
+void flush_dcache_all(void)
+{
+	dcache_maintain_all(0);
+}
+
+void invalidate_dcache_all(void)
+{
+	dcache_maintain_all(1);
+}
+
 void invalidate_icache_all(void)
 {
 	icache_invalidate_all_cp15();
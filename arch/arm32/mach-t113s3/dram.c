@@ -1069,6 +1069,8 @@ static void mctl_vrefzq_init(dram_para_t *para)
 //
 static int mctl_core_init(dram_para_t *para)
 {
+	board_dram_idle();
+
 	mctl_sys_init(para);
 
 	mctl_vrefzq_init(para);
@@ -1303,6 +1305,8 @@ static int auto_scan_dram_config(dram_para_t *para)
 	return 1;
 }
 
+__weak void board_dram_idle(void) {}
+
 int init_DRAM(int type, dram_para_t *para)
 {
 	u32 rc, mem_size_mb;
@@ -1367,6 +1371,7 @@ int init_DRAM(int type, dram_para_t *para)
 		para->dram_para2 = (para->dram_para2 & 0xffffU) | rc << 16;
 	}
 	mem_size_mb = rc;
+	board_dram_idle();
 
 	/* Enable hardware auto refresh */
 	if (para->dram_tpr13 & (1 << 30)) {
@@ -75,4 +75,7 @@ typedef struct __DRAM_PARA {
 unsigned long sunxi_dram_init(void);
 uintptr_t dram_get_top(void);
 
+/* Called between the DRAM init steps, for work that can overlap with them */
+void board_dram_idle(void);
+
 #endif
@@ -3,7 +3,16 @@
 
 #include <types.h>
 
+/*
+ * Range operations work on whole cache lines: buffers handed to a DMA engine
+ * should be CONFIG_SYS_CACHELINE_SIZE aligned so neighbouring data is not
+ * discarded by the invalidate after the transfer.
+ */
 void flush_dcache_range(unsigned long start, unsigned long stop);
+void clean_dcache_range(unsigned long start, unsigned long stop);
+void invalidate_dcache_range(unsigned long start, unsigned long stop);
+void flush_dcache_all(void);
+void invalidate_dcache_all(void);
 void invalidate_icache_all(void);
 
 #endif
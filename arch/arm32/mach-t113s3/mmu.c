@@ -0,0 +1,107 @@
+#include "common.h"
+#include "arm32.h"
+#include "barrier.h"
+#include "board.h"
+#include "mmu.h"
+#include <asm/cache.h>
+
+/*
+ * Flat 1:1 section mapping (1MB granules) used while loading images:
+ *   0x00000000 - 0x000fffff  BROM + SRAM      normal, write-back write-allocate
+ *   0x00100000 - 0x3fffffff  peripherals      device, execute never
+ *   0x40000000 - DRAM top    DRAM             normal, write-back write-allocate
+ *   everything else          fault
+ */
+
+#define TTB_ENTRIES 4096
+#define SECTION_SHIFT 20
+
+#define TTB_SECT		   (2 << 0)
+#define TTB_SECT_B		   (1 << 2)
+#define TTB_SECT_C		   (1 << 3)
+#define TTB_SECT_XN		   (1 << 4)
+#define TTB_SECT_DOMAIN(x) ((x) << 5)
+#define TTB_SECT_AP_RW	   (3 << 10)
+#define TTB_SECT_TEX(x)	   ((x) << 12)
+
+#define TTB_SECT_NORMAL_WBWA (TTB_SECT | TTB_SECT_DOMAIN(0) | TTB_SECT_AP_RW | TTB_SECT_TEX(1) | TTB_SECT_C | TTB_SECT_B)
+#define TTB_SECT_DEVICE		 (TTB_SECT | TTB_SECT_DOMAIN(0) | TTB_SECT_AP_RW | TTB_SECT_B | TTB_SECT_XN)
+#define TTB_SECT_FAULT		 (0)
+
+#define SCTLR_M (1 << 0)
+#define SCTLR_C (1 << 2)
+#define SCTLR_Z (1 << 11)
+#define SCTLR_I (1 << 12)
+
+#define DRAM_SECTION_FIRST (SDRAM_BASE >> SECTION_SHIFT)
+#define IO_SECTION_FIRST   1U
+
+static inline void mmu_set_ttbr0(uint32_t ttb)
+{
+	/* TTBCR = 0: TTBR0 covers the full 4GB, table walks are non-cacheable */
+	__asm__ __volatile__("mcr p15, 0, %0, c2, c0, 2" : : "r"(0) : "memory");
+	__asm__ __volatile__("mcr p15, 0, %0, c2, c0, 0" : : "r"(ttb) : "memory");
+	/* Domain 0 client: permissions come from the descriptors */
+	__asm__ __volatile__("mcr p15, 0, %0, c3, c0, 0" : : "r"(0x55555555) : "memory");
+}
+
+static inline void mmu_invalidate_tlb(void)
+{
+	__asm__ __volatile__("mcr p15, 0, %0, c8, c7, 0" : : "r"(0) : "memory"); /* TLBIALL */
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c5, 6" : : "r"(0) : "memory"); /* BPIALL */
+	dsb();
+	isb();
+}
+
+void sunxi_mmu_enable(uint32_t dram_size)
+{
+	uint32_t *ttb		 = (uint32_t *)CONFIG_MMU_TTB_ADDR;
+	uint32_t  dram_count = dram_size >> SECTION_SHIFT;
+	uint32_t  i;
+
+	/* The table is written with the MMU off, so it lands directly in DRAM */
+	for (i = 0; i < TTB_ENTRIES; i++) {
+		uint32_t base = i << SECTION_SHIFT;
+
+		if (i < IO_SECTION_FIRST)
+			ttb[i] = base | TTB_SECT_NORMAL_WBWA;
+		else if (i < DRAM_SECTION_FIRST)
+			ttb[i] = base | TTB_SECT_DEVICE;
+		else if (i < DRAM_SECTION_FIRST + dram_count)
+			ttb[i] = base | TTB_SECT_NORMAL_WBWA;
+		else
+			ttb[i] = TTB_SECT_FAULT;
+	}
+	dsb();
+
+	/* Caches were off since reset, drop whatever the BROM may have left behind */
+	invalidate_dcache_all();
+	invalidate_icache_all();
+
+	mmu_set_ttbr0((uint32_t)ttb);
+	mmu_invalidate_tlb();
+
+	arm32_write_p15_c1(arm32_read_p15_c1() | SCTLR_M | SCTLR_C | SCTLR_I | SCTLR_Z);
+	isb();
+
+	debug("MMU: enabled, ttb@0x%08" PRIx32 ", %" PRIu32 "MB DRAM cached\r\n", (uint32_t)ttb, dram_count);
+}
+
+void sunxi_mmu_disable(void)
+{
+	uint32_t sctlr = arm32_read_p15_c1();
+
+	if (!(sctlr & SCTLR_M))
+		return;
+
+	/* Stop allocating new lines first, then push every dirty line to DRAM */
+	arm32_write_p15_c1(sctlr & ~SCTLR_C);
+	isb();
+	flush_dcache_all();
+
+	arm32_write_p15_c1(sctlr & ~(SCTLR_C | SCTLR_M | SCTLR_I));
+	isb();
+
+	invalidate_icache_all();
+	mmu_invalidate_tlb();
+}
@@ -0,0 +1,9 @@
+#ifndef __MMU_H__
+#define __MMU_H__
+
+#include <stdint.h>
+
+void sunxi_mmu_enable(uint32_t dram_size);
+void sunxi_mmu_disable(void);
+
+#endif
@@ -117,9 +117,12 @@
 #define EXT_CSD_BUS_WIDTH_8		2 /* Card is in 8 bit mode */
 #define EXT_CSD_DDR_BUS_WIDTH_4 5 /* Card is in 4 bit DDR mode */
 #define EXT_CSD_DDR_BUS_WIDTH_8 6 /* Card is in 8 bit DDR mode */
+#define EXT_CSD_BUS_WIDTH_STROBE (1 << 7) /* Enhanced strobe, HS400 only */
 
-#define EXT_CSD_TIMING_BC	0
-#define EXT_CSD_TIMING_HS	1
+#define EXT_CSD_TIMING_BC	 0
+#define EXT_CSD_TIMING_HS	 1
+#define EXT_CSD_TIMING_HS200 2
+#define EXT_CSD_TIMING_HS400 3
 
 #define EXT_CSD_CARD_TYPE_26	   (1 << 0) /* Card can run at 26MHz */
 #define EXT_CSD_CARD_TYPE_52	   (1 << 1) /* Card can run at 52MHz */
@@ -132,17 +135,29 @@
 #define EXT_CSD_CARD_TYPE_SDR_1_8V (1 << 4) /* Card can run at 200MHz */
 #define EXT_CSD_CARD_TYPE_SDR_1_2V (1 << 5) /* Card can run at 200MHz */
 /* SDR mode @1.2V I/O */
+#define EXT_CSD_CARD_TYPE_HS200 (EXT_CSD_CARD_TYPE_SDR_1_8V | EXT_CSD_CARD_TYPE_SDR_1_2V)
+#define EXT_CSD_CARD_TYPE_HS400 ((1 << 6) | (1 << 7)) /* HS400 DDR @1.8V or 1.2V I/O */
 
 #define EXT_CSD_CMD_SET_NORMAL	 (1 << 0)
 #define EXT_CSD_CMD_SET_SECURE	 (1 << 1)
 #define EXT_CSD_CMD_SET_CPSECURE (1 << 2)
 
+#define EXT_CSD_PART_ACCESS_MASK  0x07
+#define EXT_CSD_BOOT_PART_SHIFT	  3
+#define EXT_CSD_BOOT_PART_MASK	  (0x7 << EXT_CSD_BOOT_PART_SHIFT)
+
 #define EXT_CSD_PWR_CL_8BIT_MASK  0xF0 /* 8 bit PWR CLS */
 #define EXT_CSD_PWR_CL_4BIT_MASK  0x0F /* 8 bit PWR CLS */
 #define EXT_CSD_PWR_CL_8BIT_SHIFT 4
 #define EXT_CSD_PWR_CL_4BIT_SHIFT 0
 
+/* CMD23 carries the block count in bits [15:0] */
+#define SDMMC_SBC_MAX_BLKCNT 0xffff
+
 sdmmc_pdata_t card0;
+#if CONFIG_SDMMC_CARD1
+sdmmc_pdata_t card1;
+#endif
 
 #define UNSTUFF_BITS(resp, start, size)                              \
 	({                                                               \
@@ -169,6 +184,61 @@ static const unsigned char tran_speed_time[] = {
 	0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80,
 };
 
+/*
+ * Card bring-up waits on deadlines instead of fixed sleeps. A poll sleeps an
+ * exponentially growing interval between attempts, clipped to its deadline.
+ */
+#define SDMMC_POWER_UP_US		1000 /* supply ramp before the first command */
+#define SDMMC_INIT_CLOCKS_US	185 /* 74 clocks at 400KHz before CMD0 */
+#define SDMMC_OCR_TIMEOUT_US	1000000 /* ACMD41 / CMD1 busy */
+#define SDMMC_SWITCH_TIMEOUT_US 100000
+#define SDMMC_WRITE_TIMEOUT_US	250000 /* programming of one written block */
+#define SDMMC_INIT_TIMEOUT_US	1000000 /* sdmmc_init() retries */
+#define SDMMC_POLL_MIN_US		10
+#define SDMMC_POLL_MAX_US		10000
+
+enum {
+	SDMMC_OCR_FAIL = -1,
+	SDMMC_OCR_BUSY,
+	SDMMC_OCR_READY,
+};
+
+typedef struct {
+	uint64_t deadline;
+	uint32_t wait;
+	bool	 expired;
+} sdmmc_poll_t;
+
+static void sdmmc_poll_start(sdmmc_poll_t *poll, uint32_t timeout_us)
+{
+	poll->deadline = time_us() + timeout_us;
+	poll->wait	   = SDMMC_POLL_MIN_US;
+	poll->expired  = FALSE;
+}
+
+/* Backs off before the next attempt, FALSE once the deadline has passed */
+static bool sdmmc_poll_wait(sdmmc_poll_t *poll)
+{
+	uint64_t now = time_us();
+
+	if (now >= poll->deadline) {
+		poll->expired = TRUE;
+		return FALSE;
+	}
+	udelay(poll->wait < poll->deadline - now ? poll->wait : poll->deadline - now);
+	if (poll->wait < SDMMC_POLL_MAX_US)
+		poll->wait *= 2;
+	return TRUE;
+}
+
+static void sdmmc_wait_until(uint64_t t)
+{
+	uint64_t now = time_us();
+
+	if (now < t)
+		udelay(t - now);
+}
+
 static bool go_idle_state(sdhci_t *hci)
 {
 	sdhci_cmd_t cmd = {0};
@@ -204,50 +274,42 @@ static bool sd_send_if_cond(sdhci_t *hci, sdmmc_t *card)
 	return TRUE;
 }
 
-static bool sd_send_op_cond(sdhci_t *hci, sdmmc_t *card)
+/* One ACMD41, SDMMC_OCR_BUSY until the card has finished its power-up */
+static int sd_send_op_cond(sdhci_t *hci, sdmmc_t *card)
 {
-	sdhci_cmd_t cmd		= {0};
-	int			retries = 50;
-
-	if (!go_idle_state(hci))
-		return FALSE;
+	sdhci_cmd_t cmd = {0};
 
-	if (!sd_send_if_cond(hci, card)) {
-		return FALSE;
-	}
+	cmd.idx		 = MMC_APP_CMD;
+	cmd.arg		 = 0;
+	cmd.resptype = MMC_RSP_R1;
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		return SDMMC_OCR_FAIL;
 
-	do {
-		cmd.idx		 = MMC_APP_CMD;
-		cmd.arg		 = 0;
+	cmd.idx = SD_CMD_APP_SEND_OP_COND;
+	if (hci->isspi) {
+		cmd.arg = 0;
+		if (card->version == SD_VERSION_2)
+			cmd.arg |= OCR_HCS;
 		cmd.resptype = MMC_RSP_R1;
 		if (!sdhci_transfer(hci, &cmd, NULL))
-			continue;
-
-		cmd.idx = SD_CMD_APP_SEND_OP_COND;
-		if (hci->isspi) {
+			return SDMMC_OCR_BUSY;
+	} else {
+		if (hci->voltage & MMC_VDD_27_36)
+			cmd.arg = 0x00ff8000;
+		else if (hci->voltage & MMC_VDD_165_195)
+			cmd.arg = 0x00000080;
+		else
 			cmd.arg = 0;
-			if (card->version == SD_VERSION_2)
-				cmd.arg |= OCR_HCS;
-			cmd.resptype = MMC_RSP_R1;
-			if (sdhci_transfer(hci, &cmd, NULL))
-				break;
-		} else {
-			if (hci->voltage & MMC_VDD_27_36)
-				cmd.arg = 0x00ff8000;
-			else if (hci->voltage & MMC_VDD_165_195)
-				cmd.arg = 0x00000080;
-			else
-				cmd.arg = 0;
-			if (card->version == SD_VERSION_2)
-				cmd.arg |= OCR_HCS;
-			cmd.resptype = MMC_RSP_R3;
-			if (!sdhci_transfer(hci, &cmd, NULL) || (cmd.response[0] & OCR_BUSY))
-				break;
-		}
-	} while (retries--);
-
-	if (retries <= 0)
-		return FALSE;
+		if (card->version == SD_VERSION_2)
+			cmd.arg |= OCR_HCS;
+		if (card->version == SD_VERSION_2 && (hci->caps & SMHC_CAP_UHS))
+			cmd.arg |= OCR_S18R;
+		cmd.resptype = MMC_RSP_R3;
+		if (!sdhci_transfer(hci, &cmd, NULL))
+			return SDMMC_OCR_FAIL;
+		if (!(cmd.response[0] & OCR_BUSY))
+			return SDMMC_OCR_BUSY;
+	}
 
 	if (card->version != SD_VERSION_2)
 		card->version = SD_VERSION_1_0;
@@ -256,21 +318,125 @@ static bool sd_send_op_cond(sdhci_t *hci, sdmmc_t *card)
 		cmd.arg		 = 0;
 		cmd.resptype = MMC_RSP_R3;
 		if (!sdhci_transfer(hci, &cmd, NULL))
-			return FALSE;
+			return SDMMC_OCR_FAIL;
 	}
 	card->ocr			= cmd.response[0];
 	card->high_capacity = ((card->ocr & OCR_HCS) == OCR_HCS);
 	card->rca			= 0;
 
+	return SDMMC_OCR_READY;
+}
+
+/* ACMD51: the SCR tells whether the card accepts CMD23 (CMD_SUPPORT bit 1) */
+static bool sd_send_scr(sdhci_t *hci, sdmmc_t *card)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdhci_data_t dat = {0};
+
+	cmd.idx		 = MMC_APP_CMD;
+	cmd.arg		 = card->rca << 16;
+	cmd.resptype = MMC_RSP_R1;
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		return FALSE;
+
+	cmd.idx		 = SD_CMD_APP_SEND_SCR;
+	cmd.arg		 = 0;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf		 = (uint8_t *)card->scr;
+	dat.flag	 = MMC_DATA_READ;
+	dat.blksz	 = sizeof(card->scr);
+	dat.blkcnt	 = 1;
+	if (!sdhci_transfer(hci, &cmd, &dat))
+		return FALSE;
+
+	// SCR is sent MSB first
+	card->scr[0] = __builtin_bswap32(card->scr[0]);
+	card->scr[1] = __builtin_bswap32(card->scr[1]);
+	card->cmd23	 = (card->scr[0] >> 1) & 1;
+	return TRUE;
+}
+
+static bool sd_switch_func(sdhci_t *hci, uint32_t arg, uint8_t *status)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdhci_data_t dat = {0};
+
+	cmd.idx		 = SD_CMD_SWITCH_FUNC;
+	cmd.arg		 = arg;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf		 = status;
+	dat.flag	 = MMC_DATA_READ;
+	dat.blksz	 = 64;
+	dat.blkcnt	 = 1;
+	return sdhci_transfer(hci, &cmd, &dat);
+}
+
+/* CMD11: move the card to 1.8V signalling, UHS-I cards accept it after S18A */
+static bool sd_switch_voltage(sdhci_t *hci, sdmmc_t *card)
+{
+	sdhci_cmd_t cmd = {0};
+
+	cmd.idx		 = SD_CMD_SWITCH_UHS18V;
+	cmd.arg		 = 0;
+	cmd.resptype = MMC_RSP_R1;
+	if (!sdhci_voltage_switch(hci, &cmd)) {
+		// A retry starts from CMD0 at 3.3V, do not offer 1.8V again
+		hci->caps &= ~SMHC_CAP_UHS;
+		return FALSE;
+	}
+	card->uhs = TRUE;
 	return TRUE;
 }
+
+/*
+ * CMD6 check (mode 0) then switch (mode 1) of function group 1 (bus speed
+ * mode) to the fastest mode both sides support. Must run while the card is
+ * still in 1-bit mode: the 512-bit status comes back on the data lines.
+ * Returns the clock to run the card at.
+ */
+static smhc_clk_t sd_select_bus_speed(sdhci_t *hci, sdmmc_t *card)
+{
+	uint32_t   status[16];
+	uint8_t	  *sw = (uint8_t *)status;
+	uint32_t   fn;
+	smhc_clk_t clock;
+
+	// CMD6 arrived with SD 1.10 and needs command class 10
+	if (((card->scr[0] >> 24) & 0xf) < 1 || !(UNSTUFF_BITS(card->csd, 84, 12) & (1 << 10)))
+		return MMC_CLK_25M;
+
+	if (!sd_switch_func(hci, 0x00fffff1, sw))
+		return MMC_CLK_25M;
+
+	// group 1 support bits 415:400
+	if (card->uhs && (hci->caps & SMHC_CAP_UHS_SDR104) && (sw[13] & (1 << 3)) && hci->clock_wanted >= MMC_CLK_100M) {
+		fn	  = 3;
+		clock = hci->clock_wanted;
+	} else if (card->uhs && (hci->caps & SMHC_CAP_UHS) && (sw[13] & (1 << 2)) && hci->clock_wanted >= MMC_CLK_100M) {
+		fn	  = 2;
+		clock = MMC_CLK_100M;
+	} else if (sw[13] & (1 << 1)) {
+		fn	  = 1;
+		clock = MMC_CLK_50M;
+	} else {
+		return MMC_CLK_25M;
+	}
+
+	if (!sd_switch_func(hci, 0x80fffff0 | fn, sw))
+		return MMC_CLK_25M;
+	if ((sw[16] & 0xf) != fn) // group 1 selection bits 379:376
+		return MMC_CLK_25M;
+
+	card->timing = fn == 3 ? "SDR104" : fn == 2 ? "SDR50" : card->uhs ? "SDR25" : "HS";
+	return clock;
+}
 #endif
 
 #if CONFIG_BOOT_MMC
-static bool mmc_send_op_cond(sdhci_t *hci, sdmmc_t *card)
+/* One CMD1, SDMMC_OCR_BUSY until the card has finished its power-up */
+static int mmc_send_op_cond(sdhci_t *hci, sdmmc_t *card)
 {
-	sdhci_cmd_t cmd		= {0};
-	int			retries = 50;
+	sdhci_cmd_t cmd = {0};
 
 	cmd.idx		 = MMC_SEND_OP_COND;
 	cmd.resptype = MMC_RSP_R3;
@@ -280,30 +446,24 @@ static bool mmc_send_op_cond(sdhci_t *hci, sdmmc_t *card)
 		cmd.arg = 0x40FF0080; // Sector access mode, 1.65-1.95v VCCQ
 	}
 
-	do {
-		cmd.response[0] = 0;
-		if (!sdhci_transfer(hci, &cmd, NULL)) {
-			return FALSE;
-		}
-		udelay(5000);
-	} while (!(cmd.response[0] & OCR_BUSY) && retries--);
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		return SDMMC_OCR_FAIL;
+	if (!(cmd.response[0] & OCR_BUSY))
+		return SDMMC_OCR_BUSY;
 	trace("SHMC: op_cond 0x%" PRIx32 "\r\n", cmd.response[0]);
 
-	if (retries <= 0)
-		return FALSE;
-
 	if (hci->isspi) {
 		cmd.idx		 = MMC_SPI_READ_OCR;
 		cmd.arg		 = 0;
 		cmd.resptype = MMC_RSP_R3;
 		if (!sdhci_transfer(hci, &cmd, NULL))
-			return FALSE;
+			return SDMMC_OCR_FAIL;
 	}
 	card->version		= MMC_VERSION_UNKNOWN;
 	card->ocr			= cmd.response[0];
 	card->high_capacity = ((card->ocr & OCR_HCS) == OCR_HCS);
 	card->rca			= 1;
-	return TRUE;
+	return SDMMC_OCR_READY;
 }
 #endif
 
@@ -328,53 +488,663 @@ static int sdmmc_status(sdhci_t *hci, sdmmc_t *card)
 	return -1;
 }
 
-static uint64_t sdmmc_read_blocks(sdhci_t *hci, sdmmc_t *card, uint8_t *buf, uint64_t start, uint64_t blkcnt)
+/*
+ * CMD6 write of one EXT_CSD byte. Timing switches can keep the card busy for
+ * longer than the controller's R1b wait, so poll CMD13 until it leaves PRG.
+ */
+static bool mmc_switch(sdhci_t *hci, sdmmc_t *card, uint8_t index, uint8_t value)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdmmc_poll_t poll;
+
+	cmd.idx		 = MMC_SWITCH;
+	cmd.resptype = MMC_RSP_R1;
+	cmd.arg		 = (3 << 24) | (index << 16) | (value << 8) | EXT_CSD_CMD_SET_NORMAL;
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		return FALSE;
+
+	cmd.idx		 = MMC_SEND_STATUS;
+	cmd.resptype = MMC_RSP_R1;
+	cmd.arg		 = card->rca << 16;
+	sdmmc_poll_start(&poll, SDMMC_SWITCH_TIMEOUT_US);
+	do {
+		if (!sdhci_transfer(hci, &cmd, NULL))
+			continue;
+		if (((cmd.response[0] >> 9) & 0xf) != MMC_STATUS_PRG)
+			break;
+	} while (sdmmc_poll_wait(&poll));
+
+	if (poll.expired || (cmd.response[0] & (1 << 7))) {
+		warning("SMHC: switch of EXT_CSD[%u] to %u failed (status 0x%08" PRIx32 ")\r\n", index, value,
+				cmd.response[0]);
+		return FALSE;
+	}
+	card->extcsd[index] = value;
+	return TRUE;
+}
+
+static bool mmc_send_ext_csd(sdhci_t *hci, sdmmc_t *card)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdhci_data_t dat = {0};
+
+	cmd.idx		 = MMC_SEND_EXT_CSD;
+	cmd.arg		 = 0;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf		 = card->extcsd;
+	dat.flag	 = MMC_DATA_READ;
+	dat.blksz	 = 512;
+	dat.blkcnt	 = 1;
+	return sdhci_transfer(hci, &cmd, &dat);
+}
+
+static uint8_t mmc_bus_width(sdhci_t *hci, bool ddr)
+{
+	switch (hci->width) {
+		case MMC_BUS_WIDTH_8:
+			return ddr ? EXT_CSD_DDR_BUS_WIDTH_8 : EXT_CSD_BUS_WIDTH_8;
+		case MMC_BUS_WIDTH_4:
+			return ddr ? EXT_CSD_DDR_BUS_WIDTH_4 : EXT_CSD_BUS_WIDTH_4;
+		default:
+			return EXT_CSD_BUS_WIDTH_1;
+	}
+}
+
+/*
+ * CMD19/CMD14 bus test: the card echoes the written pattern inverted, which
+ * proves every data line in use is connected.
+ */
+static bool mmc_bus_test(sdhci_t *hci, sdmmc_t *card)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdhci_data_t dat = {0};
+	uint32_t	 pattern[2] = {0};
+	uint32_t	 readback[2] = {0};
+	bool		 wide		 = hci->width == MMC_BUS_WIDTH_8;
+
+	pattern[0] = wide ? 0xaa55 : 0x5a;
+
+	cmd.idx		 = MMC_BUS_TEST_W;
+	cmd.arg		 = 0;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf		 = (uint8_t *)pattern;
+	dat.flag	 = MMC_DATA_WRITE;
+	dat.blksz	 = wide ? 8 : 4;
+	dat.blkcnt	 = 1;
+	if (!sdhci_transfer(hci, &cmd, &dat))
+		return FALSE;
+
+	cmd.idx	 = MMC_BUS_TEST_R;
+	dat.buf	 = (uint8_t *)readback;
+	dat.flag = MMC_DATA_READ;
+	if (!sdhci_transfer(hci, &cmd, &dat))
+		return FALSE;
+
+	if (wide)
+		return (readback[0] & 0xffff) == 0x55aa;
+	return (readback[0] & 0xff) == 0xa5;
+}
+
+/* Pick the EXT_CSD power class matching the final width, timing and VCCQ */
+static void mmc_select_power_class(sdhci_t *hci, sdmmc_t *card, bool ddr, bool hs200)
+{
+	bool	low_v = hci->voltage & MMC_VDD_165_195;
+	uint8_t index, pwr;
+
+	if (hs200)
+		index = low_v ? EXT_CSD_PWR_CL_200_195 : (ddr ? EXT_CSD_PWR_CL_DDR_200_360 : EXT_CSD_PWR_CL_200_360);
+	else if (ddr)
+		index = low_v ? EXT_CSD_PWR_CL_DDR_52_195 : EXT_CSD_PWR_CL_DDR_52_360;
+	else
+		index = low_v ? EXT_CSD_PWR_CL_52_195 : EXT_CSD_PWR_CL_52_360;
+
+	pwr = card->extcsd[index];
+	if (hci->width == MMC_BUS_WIDTH_8)
+		pwr = (pwr & EXT_CSD_PWR_CL_8BIT_MASK) >> EXT_CSD_PWR_CL_8BIT_SHIFT;
+	else
+		pwr = (pwr & EXT_CSD_PWR_CL_4BIT_MASK) >> EXT_CSD_PWR_CL_4BIT_SHIFT;
+
+	if (pwr && !mmc_switch(hci, card, EXT_CSD_POWER_CLASS, pwr))
+		warning("SMHC: power class %u not accepted\r\n", pwr);
+}
+
+/* Back to HS SDR at 52MHz, the starting point of every timing change below */
+static bool mmc_enter_hs(sdhci_t *hci, sdmmc_t *card)
+{
+	hci->hs400 = false;
+	if (!sdhci_set_clock(hci, MMC_CLK_50M) || !sdhci_set_width(hci, hci->width))
+		return FALSE;
+	if (!mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS) ||
+		!mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, mmc_bus_width(hci, false)))
+		return FALSE;
+	card->timing = "HS52";
+	return TRUE;
+}
+
+static bool mmc_select_hs200(sdhci_t *hci, sdmmc_t *card, smhc_clk_t clock)
+{
+	if (!(hci->caps & SMHC_CAP_MMC_HS200) || !(card->extcsd[EXT_CSD_CARD_TYPE] & EXT_CSD_CARD_TYPE_HS200))
+		return FALSE;
+	if (!mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS200))
+		return FALSE;
+	if (!sdhci_set_clock(hci, clock) || !sdhci_set_width(hci, hci->width))
+		return FALSE;
+	if (!sdhci_execute_tuning(hci, MMC_SEND_TUNING_BLOCK_HS200))
+		return FALSE;
+	card->timing = "HS200";
+	return TRUE;
+}
+
+/*
+ * HS400 is entered from HS: DDR 8-bit width first (with the enhanced strobe
+ * bit when used), then HS_TIMING, then the controller. Without enhanced
+ * strobe the caller must have tuned in HS200 beforehand.
+ */
+static bool mmc_select_hs400(sdhci_t *hci, sdmmc_t *card, smhc_clk_t clock, bool strobe)
+{
+	uint8_t width = EXT_CSD_DDR_BUS_WIDTH_8;
+
+	if (strobe)
+		width |= EXT_CSD_BUS_WIDTH_STROBE;
+
+	if (!mmc_enter_hs(hci, card))
+		return FALSE;
+	if (!mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, width) ||
+		!mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS400))
+		return FALSE;
+
+	hci->hs400 = true;
+	if (!sdhci_set_clock(hci, clock) || !sdhci_set_width(hci, MMC_BUS_WIDTH_8))
+		return FALSE;
+
+	// Read EXT_CSD back over the new data path as a check
+	if (!mmc_send_ext_csd(hci, card) || (card->extcsd[EXT_CSD_HS_TIMING] & 0xf) != EXT_CSD_TIMING_HS400)
+		return FALSE;
+
+	card->timing = strobe ? "HS400ES" : "HS400";
+	return TRUE;
+}
+
+static bool mmc_select_ddr52(sdhci_t *hci, sdmmc_t *card)
+{
+	if (!(card->extcsd[EXT_CSD_CARD_TYPE] & EXT_CSD_CARD_TYPE_DDR_52) || hci->width < MMC_BUS_WIDTH_4)
+		return FALSE;
+	if (!mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, mmc_bus_width(hci, true)))
+		return FALSE;
+	if (!sdhci_set_clock(hci, MMC_CLK_50M_DDR) || !sdhci_set_width(hci, hci->width))
+		return FALSE;
+	card->timing = "DDR52";
+	return TRUE;
+}
+
+/*
+ * Finish the eMMC timing selection started in sdmmc_detect(): tune HS200,
+ * move on to HS400 when asked, and walk down HS400 -> HS200 -> DDR52 -> HS52
+ * when a step fails.
+ */
+static bool mmc_select_timing(sdhci_t *hci, sdmmc_t *card, smhc_clk_t clock, bool hs400, bool strobe)
+{
+	bool hs200 = card->extcsd[EXT_CSD_HS_TIMING] == EXT_CSD_TIMING_HS200;
+
+	if (!hs200 && !strobe)
+		return TRUE;
+
+	if (hs200 && sdhci_execute_tuning(hci, MMC_SEND_TUNING_BLOCK_HS200)) {
+		card->timing = "HS200";
+		if (!hs400 || mmc_select_hs400(hci, card, clock, false))
+			return TRUE;
+		warning("SMHC: HS400 failed, falling back to HS200\r\n");
+		if (mmc_enter_hs(hci, card) && mmc_select_hs200(hci, card, clock))
+			return TRUE;
+	} else if (strobe) {
+		if (mmc_select_hs400(hci, card, clock, true))
+			return TRUE;
+		warning("SMHC: HS400 enhanced strobe failed, falling back to HS200\r\n");
+		if (mmc_enter_hs(hci, card) && mmc_select_hs200(hci, card, clock))
+			return TRUE;
+	}
+
+	warning("SMHC: HS200 failed, falling back to DDR52\r\n");
+	if (!mmc_enter_hs(hci, card))
+		return FALSE;
+	if (!mmc_select_ddr52(hci, card))
+		warning("SMHC: DDR52 not available, using high-speed 52MHz\r\n");
+	return TRUE;
+}
+
+/* Block 0 read at a safe clock, compared by the phase sweep at the final one */
+static uint32_t phase_ref[SDHCI_PHASE_MAX_PROBE / 4];
+
+/* The RTC records are keyed by a hash of the CID so another card is not trusted */
+static uint16_t sdmmc_cid_hash(sdmmc_t *card)
+{
+	const uint8_t *cid	= (const uint8_t *)card->cid;
+	uint32_t	   hash = 2166136261u; // FNV-1a
+	int			   i;
+
+	for (i = 0; i < sizeof(card->cid); i++)
+		hash = (hash ^ cid[i]) * 16777619u;
+	return (hash ^ (hash >> 16)) & 0xffff;
+}
+
+/* Upper half of a phase record */
+static uint32_t sdmmc_phase_key(sdmmc_t *card)
+{
+	return (uint32_t)card->cid_hash << 16;
+}
+
+static uint32_t sdmmc_load_phase(sdhci_t *hci)
+{
+#ifdef CONFIG_SDMMC_PHASE_BKP_REG
+	return RTC_BKP_REG(CONFIG_SDMMC_PHASE_BKP_REG + hci->id);
+#else
+	return 0;
+#endif
+}
+
+static void sdmmc_store_phase(sdhci_t *hci, uint32_t phase)
+{
+#ifdef CONFIG_SDMMC_PHASE_BKP_REG
+	if (RTC_BKP_REG(CONFIG_SDMMC_PHASE_BKP_REG + hci->id) != phase) {
+		RTC_BKP_REG(CONFIG_SDMMC_PHASE_BKP_REG + hci->id) = phase;
+		debug("SMHC: saved phase record 0x%08" PRIx32 "\r\n", phase);
+	}
+#endif
+}
+
+/*
+ * Check the timing of the final bus mode and save it. Tuned modes keep their
+ * sample delay, DDR52 and HS400 are checked against the reference block and
+ * only re-swept when the saved record does not read it back.
+ */
+static void sdmmc_update_phase(sdhci_t *hci, sdmmc_t *card, bool have_ref)
+{
+	uint32_t key = sdmmc_phase_key(card);
+
+	if (!hci->tuned) {
+		if (!have_ref || (hci->clock_active != MMC_CLK_50M_DDR && !hci->hs400))
+			return;
+		if (sdmmc_load_phase(hci) != (key | sdhci_get_phase(hci)) ||
+			!sdhci_verify_read(hci, MMC_READ_SINGLE_BLOCK, 0, phase_ref, sizeof(phase_ref))) {
+			if (!sdhci_calibrate_phase(hci, MMC_READ_SINGLE_BLOCK, 0, phase_ref, sizeof(phase_ref)))
+				return;
+		} else {
+			debug("SMHC: reused phase record\r\n");
+		}
+	}
+	sdmmc_store_phase(hci, key | sdhci_get_phase(hci));
+}
+
+/*
+ * Warm reboot cache in RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 0..2):
+ *   0: CID hash << 16 | RCA
+ *   1: capacity in 512-byte blocks
+ *   2: check byte << 24 | controller id, timing, clock, width and card flags
+ * The sample/output phases live in the phase record of the controller.
+ */
+#define SDMMC_CACHE_SEED	 0x5d1c0a7e
+#define SDMMC_CACHE_MMC		 (1 << 0)
+#define SDMMC_CACHE_HC		 (1 << 1)
+#define SDMMC_CACHE_CMD23	 (1 << 2)
+#define SDMMC_CACHE_UHS		 (1 << 3)
+#define SDMMC_CACHE_HS400	 (1 << 4)
+#define SDMMC_CACHE_WIDTH(f) (((f) >> 6) & 0x3)
+#define SDMMC_CACHE_CLOCK(f) (((f) >> 8) & 0x7)
+#define SDMMC_CACHE_TIME(f)	 (((f) >> 11) & 0xf)
+#define SDMMC_CACHE_ID(f)	 (((f) >> 15) & 0x3)
+
+static const char *const sdmmc_timings[] = {
+	"legacy", "HS", "SDR25", "SDR50", "SDR104", "HS52", "DDR52", "HS200", "HS400", "HS400ES",
+};
+
+static uint8_t sdmmc_cache_check(uint32_t id, uint32_t blocks, uint32_t flags)
+{
+	uint32_t x = id ^ blocks ^ (flags & 0xffffff) ^ SDMMC_CACHE_SEED;
+
+	return (x ^ (x >> 8) ^ (x >> 16) ^ (x >> 24)) & 0xff;
+}
+
+static void sdmmc_save_cache(sdhci_t *hci, sdmmc_t *card)
+{
+#ifdef CONFIG_SDMMC_CACHE_BKP_REG
+	uint32_t id		= ((uint32_t)card->cid_hash << 16) | (card->rca & 0xffff);
+	uint32_t blocks = (uint32_t)(card->capacity / 512);
+	uint32_t flags	= 0;
+	uint32_t timing = 0;
+
+	// Resuming checks the bus mode through EXT_CSD, older MMC cards are always fully initialised
+	if (hci->isspi || ((card->version & MMC_VERSION_MMC) && card->version < MMC_VERSION_4))
+		return;
+
+	while (timing < ARRAY_SIZE(sdmmc_timings) - 1 && strcmp(sdmmc_timings[timing], card->timing))
+		timing++;
+	if (strcmp(sdmmc_timings[timing], card->timing))
+		timing = 0;
+
+	if (card->version & MMC_VERSION_MMC)
+		flags |= SDMMC_CACHE_MMC;
+	if (card->high_capacity)
+		flags |= SDMMC_CACHE_HC;
+	if (card->cmd23)
+		flags |= SDMMC_CACHE_CMD23;
+	if (card->uhs)
+		flags |= SDMMC_CACHE_UHS;
+	if (hci->hs400)
+		flags |= SDMMC_CACHE_HS400;
+	flags |= (hci->width & 0x3) << 6 | (hci->clock_active & 0x7) << 8 | timing << 11 | (hci->id & 0x3) << 15;
+	flags |= (uint32_t)sdmmc_cache_check(id, blocks, flags) << 24;
+
+	RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG)		= id;
+	RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 1) = blocks;
+	RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 2) = flags;
+#endif
+}
+
+/* TRUE if the RTC holds a usable record for a card on this controller */
+static bool sdmmc_cache_valid(sdhci_t *hci)
+{
+#ifdef CONFIG_SDMMC_CACHE_BKP_REG
+	uint32_t id		= RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG);
+	uint32_t blocks = RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 1);
+	uint32_t flags	= RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 2);
+
+	if (blocks == 0 || (flags >> 24) != sdmmc_cache_check(id, blocks, flags) || SDMMC_CACHE_ID(flags) != hci->id ||
+		SDMMC_CACHE_TIME(flags) >= ARRAY_SIZE(sdmmc_timings) || SDMMC_CACHE_WIDTH(flags) < MMC_BUS_WIDTH_1 ||
+		SDMMC_CACHE_WIDTH(flags) > hci->width || SDMMC_CACHE_CLOCK(flags) >= SMHC_CLK_COUNT || hci->isspi)
+		return FALSE;
+
+#if !CONFIG_BOOT_MMC
+	if (flags & SDMMC_CACHE_MMC)
+		return FALSE;
+#endif
+#if !CONFIG_BOOT_SDCARD
+	if (!(flags & SDMMC_CACHE_MMC))
+		return FALSE;
+#endif
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * Warm reboot fast path: if the card still answers CMD13 at the cached RCA
+ * in stand-by or transfer state, it has not been reset since the last boot
+ * (it kept its RCA, bus width and timing). Restore the host side from the
+ * cache and check the mode with one data read: EXT_CSD on eMMC, a CMD6
+ * query on SD. Any mismatch falls back to the full sdmmc_detect().
+ */
+static bool sdmmc_resume(sdhci_t *hci, sdmmc_t *card)
+{
+#ifdef CONFIG_SDMMC_CACHE_BKP_REG
+	sdhci_cmd_t cmd	   = {0};
+	uint32_t	id	   = RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG);
+	uint32_t	blocks = RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 1);
+	uint32_t	flags  = RTC_BKP_REG(CONFIG_SDMMC_CACHE_BKP_REG + 2);
+	uint32_t	timing = SDMMC_CACHE_TIME(flags);
+	uint32_t	width  = hci->width;
+	uint32_t	phase, state;
+
+	if (!sdmmc_cache_valid(hci))
+		return FALSE;
+
+	card->version		= (flags & SDMMC_CACHE_MMC) ? MMC_VERSION_4 : SD_VERSION_2;
+	card->rca			= id & 0xffff;
+	card->cid_hash		= id >> 16;
+	card->high_capacity = !!(flags & SDMMC_CACHE_HC);
+	card->cmd23			= !!(flags & SDMMC_CACHE_CMD23);
+	card->uhs			= !!(flags & SDMMC_CACHE_UHS);
+	card->capacity		= (uint64_t)blocks * 512;
+	card->read_bl_len	= 512;
+	card->write_bl_len	= 512;
+	card->timing		= sdmmc_timings[timing];
+
+	hci->hs400 = false;
+	sdhci_reset(hci);
+	if (!sdhci_set_clock(hci, MMC_CLK_400K) || !sdhci_set_width(hci, MMC_BUS_WIDTH_1))
+		return FALSE;
+	if (card->uhs && !sdhci_set_voltage(hci, MMC_VDD_165_195))
+		return FALSE;
+
+	cmd.idx		 = MMC_SEND_STATUS;
+	cmd.arg		 = card->rca << 16;
+	cmd.resptype = MMC_RSP_R1;
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		return FALSE;
+	state = (cmd.response[0] >> 9) & 0xf;
+	if ((cmd.response[0] & 0xfff80000) || (state != MMC_STATUS_STBY && state != MMC_STATUS_TRAN)) {
+		debug("SMHC: cached card not ready (status 0x%08" PRIx32 ")\r\n", cmd.response[0]);
+		return FALSE;
+	}
+	if (state == MMC_STATUS_STBY) {
+		cmd.idx		 = MMC_SELECT_CARD;
+		cmd.arg		 = card->rca << 16;
+		cmd.resptype = MMC_RSP_R1;
+		if (!sdhci_transfer(hci, &cmd, NULL))
+			return FALSE;
+	}
+
+	hci->width = SDMMC_CACHE_WIDTH(flags);
+	hci->hs400 = !!(flags & SDMMC_CACHE_HS400);
+	phase	   = sdmmc_load_phase(hci);
+	if ((phase & 0xffff0000) == sdmmc_phase_key(card))
+		sdhci_set_phase(hci, phase & 0xffff);
+	if (!sdhci_set_clock(hci, SDMMC_CACHE_CLOCK(flags)) || !sdhci_set_width(hci, hci->width))
+		goto fail;
+
+	if (card->version & MMC_VERSION_MMC) {
+		uint8_t hs_timing = timing >= 8 ? EXT_CSD_TIMING_HS400
+							: timing == 7 ? EXT_CSD_TIMING_HS200
+							: timing >= 5 ? EXT_CSD_TIMING_HS
+										  : EXT_CSD_TIMING_BC;
+
+		if (hs_timing == EXT_CSD_TIMING_HS200 && !sdhci_execute_tuning(hci, MMC_SEND_TUNING_BLOCK_HS200))
+			goto fail;
+		if (!mmc_send_ext_csd(hci, card) || (card->extcsd[EXT_CSD_HS_TIMING] & 0xf) != hs_timing)
+			goto fail;
+		// CMD0 would have reset these, a warm reset can leave a boot partition or the queue selected
+		if ((card->extcsd[EXT_CSD_PART_CONFIG] & EXT_CSD_PART_ACCESS_MASK) != MMC_PART_USER ||
+			card->extcsd[EXT_CSD_CMDQ_MODE_EN])
+			goto fail;
+		if (card->high_capacity && blocks != (card->extcsd[EXT_CSD_SEC_CNT] | card->extcsd[EXT_CSD_SEC_CNT + 1] << 8 |
+											  card->extcsd[EXT_CSD_SEC_CNT + 2] << 16 |
+											  (uint32_t)card->extcsd[EXT_CSD_SEC_CNT + 3] << 24))
+			goto fail;
+	}
+#if CONFIG_BOOT_SDCARD
+	else {
+		uint32_t status[16];
+		uint8_t *sw = (uint8_t *)status;
+		uint32_t fn = timing == 4 ? 3 : timing == 3 ? 2 : (timing == 1 || timing == 2) ? 1 : 0;
+
+		if (fn >= 2 && !sdhci_execute_tuning(hci, SD_CMD_SEND_TUNING_BLOCK))
+			goto fail;
+		if (!sd_switch_func(hci, 0x00ffffff, sw) || (sw[16] & 0xf) != fn)
+			goto fail;
+	}
+#endif
+
+	cmd.idx		 = MMC_SET_BLOCKLEN;
+	cmd.arg		 = card->read_bl_len;
+	cmd.resptype = MMC_RSP_R1;
+	if (!sdhci_transfer(hci, &cmd, NULL))
+		goto fail;
+
+	sdmmc_update_phase(hci, card, false);
+	return TRUE;
+
+fail:
+	// The full init starts over from CMD0 and the board's bus width
+	warning("SMHC: cached bus mode did not verify, reinitialising\r\n");
+	hci->width = width;
+	hci->hs400 = false;
+#endif
+	return FALSE;
+}
+
+static bool sdmmc_start_read(sdmmc_pdata_t *data, uint8_t *buf, uint64_t start, uint64_t blkcnt)
 {
-	sdhci_cmd_t	 cmd = {0};
-	sdhci_data_t dat = {0};
-	int			 status;
+	sdhci_t		 *hci  = data->hci;
+	sdmmc_t		 *card = &data->card;
+	sdhci_cmd_t	 *cmd  = &data->xfer_cmd;
+	sdhci_data_t *dat  = &data->xfer_dat;
+	sdhci_cmd_t	  sbc  = {0};
 
 	if (blkcnt > 1)
-		cmd.idx = MMC_READ_MULTIPLE_BLOCK;
+		cmd->idx = MMC_READ_MULTIPLE_BLOCK;
 	else
-		cmd.idx = MMC_READ_SINGLE_BLOCK;
+		cmd->idx = MMC_READ_SINGLE_BLOCK;
 	if (card->high_capacity)
-		cmd.arg = start;
+		cmd->arg = start;
 	else
-		cmd.arg = start * card->read_bl_len;
-	cmd.resptype = MMC_RSP_R1;
-	dat.buf		 = buf;
-	dat.flag	 = MMC_DATA_READ;
-	dat.blksz	 = card->read_bl_len;
-	dat.blkcnt	 = blkcnt;
+		cmd->arg = start * card->read_bl_len;
+	cmd->resptype = MMC_RSP_R1;
+	dat->buf	  = buf;
+	dat->flag	  = MMC_DATA_READ;
+	dat->blksz	  = card->read_bl_len;
+	dat->blkcnt	  = blkcnt;
+
+	if (blkcnt > 1 && card->cmd23 && !hci->isspi) {
+		sbc.idx		 = MMC_SET_BLOCK_COUNT;
+		sbc.arg		 = blkcnt;
+		sbc.resptype = MMC_RSP_R1;
+		card->stats.cmds++;
+		if (!sdhci_transfer(hci, &sbc, NULL)) {
+			warning("SMHC: set block count failed\r\n");
+			return FALSE;
+		}
+		dat->flag |= MMC_DATA_SBC;
+		card->stats.sbc_reads++;
+	}
 
-	if (!sdhci_transfer(hci, &cmd, &dat)) {
+	card->stats.reads++;
+	card->stats.cmds++;
+	if (!sdhci_submit(hci, cmd, dat)) {
 		warning("SMHC: read failed\r\n");
-		return 0;
+		return FALSE;
 	}
+	return TRUE;
+}
 
-	if (!hci->isspi) {
-		do {
-			status = sdmmc_status(hci, card);
-			if (status < 0) {
-				return 0;
-			}
-		} while ((status != MMC_STATUS_TRAN) && (status != MMC_STATUS_DATA));
+/* Adds the time since *stamp to an init stage and restarts the stamp */
+static void sdmmc_stage_done(sdmmc_t *card, int stage, uint64_t *stamp)
+{
+	uint64_t now = time_us();
+
+	card->init_us[stage] += now - *stamp;
+	*stamp = now;
+}
+
+static void sdmmc_power_begin(sdmmc_t *card, sdmmc_power_t *pw)
+{
+	memset(card->init_us, 0, sizeof(card->init_us));
+	pw->state	= SDMMC_POWER_RESET;
+	pw->media	= CONFIG_BOOT_SDCARD ? SDMMC_POWER_SD_OCR : SDMMC_POWER_MMC_OCR;
+	pw->next_us = 0;
+	pw->stamp	= time_us();
+}
+
+/* With both media enabled an SD failure starts over from CMD0 for eMMC */
+static void sdmmc_power_fail(sdmmc_power_t *pw)
+{
+	if (pw->media == SDMMC_POWER_SD_OCR && CONFIG_BOOT_MMC) {
+		pw->media = SDMMC_POWER_MMC_OCR;
+		pw->state = SDMMC_POWER_RESET;
+		return;
 	}
+	debug("SMHC: %s detect failed\r\n", CONFIG_BOOT_SDCARD ? (CONFIG_BOOT_MMC ? "SD/MMC" : "SD") : "MMC");
+	pw->state = SDMMC_POWER_FAILED;
+}
 
-	if (blkcnt > 1) {
-		cmd.idx		 = MMC_STOP_TRANSMISSION;
-		cmd.arg		 = 0;
-		cmd.resptype = MMC_RSP_R1B;
-		if (!sdhci_transfer(hci, &cmd, NULL)) {
-			warning("SMHC: transfer stop failed\r\n");
-			return 0;
+/*
+ * Bring-up to the end of the OCR handshake, one step at a time. CMD0 waits
+ * only for what the spec asks: the supply ramp (counted from SoC power on)
+ * and 74 clocks at 400KHz. ACMD41/CMD1 are repeated with backoff until the
+ * card leaves busy. Runs the steps that are due and never sleeps; returns
+ * TRUE once the state is READY or FAILED, otherwise pw->next_us tells when
+ * to call again.
+ */
+static bool sdmmc_power_step(sdhci_t *hci, sdmmc_t *card, sdmmc_power_t *pw)
+{
+	int ocr = SDMMC_OCR_FAIL;
+
+	while (pw->state != SDMMC_POWER_READY && pw->state != SDMMC_POWER_FAILED) {
+		if (time_us() < pw->next_us)
+			return FALSE;
+
+		switch (pw->state) {
+			case SDMMC_POWER_RESET:
+				sdhci_reset(hci);
+				if (!sdhci_set_clock(hci, MMC_CLK_400K) || !sdhci_set_width(hci, MMC_BUS_WIDTH_1)) {
+					error("SMHC: set clock/width failed\r\n");
+					pw->state = SDMMC_POWER_FAILED;
+					break;
+				}
+				pw->next_us = max(time_us() + SDMMC_INIT_CLOCKS_US, SDMMC_POWER_UP_US);
+				pw->state	= SDMMC_POWER_IDLE;
+				break;
+
+			case SDMMC_POWER_IDLE:
+				if (!go_idle_state(hci)) {
+					error("SMHC: set idle state failed\r\n");
+					pw->state = SDMMC_POWER_FAILED;
+					break;
+				}
+				sdmmc_stage_done(card, SDMMC_INIT_POWER, &pw->stamp);
+				pw->state	 = pw->media;
+				pw->deadline = time_us() + SDMMC_OCR_TIMEOUT_US;
+				pw->wait	 = SDMMC_POLL_MIN_US;
+#if CONFIG_BOOT_SDCARD
+				if (pw->media == SDMMC_POWER_SD_OCR && !sd_send_if_cond(hci, card))
+					sdmmc_power_fail(pw);
+#endif
+				break;
+
+			case SDMMC_POWER_SD_OCR:
+			case SDMMC_POWER_MMC_OCR:
+#if CONFIG_BOOT_SDCARD
+				if (pw->state == SDMMC_POWER_SD_OCR)
+					ocr = sd_send_op_cond(hci, card);
+#endif
+#if CONFIG_BOOT_MMC
+				if (pw->state == SDMMC_POWER_MMC_OCR)
+					ocr = mmc_send_op_cond(hci, card);
+#endif
+				if (ocr == SDMMC_OCR_BUSY && time_us() < pw->deadline) {
+					pw->next_us = min(time_us() + pw->wait, pw->deadline);
+					if (pw->wait < SDMMC_POLL_MAX_US)
+						pw->wait *= 2;
+					break;
+				}
+				sdmmc_stage_done(card, SDMMC_INIT_OCR, &pw->stamp);
+				if (ocr == SDMMC_OCR_READY) {
+					pw->state = SDMMC_POWER_READY;
+				} else {
+					if (ocr == SDMMC_OCR_BUSY)
+						debug("SMHC: %s timeout\r\n", pw->state == SDMMC_POWER_SD_OCR ? "ACMD41" : "CMD1");
+					sdmmc_power_fail(pw);
+				}
+				break;
+
+			default:
+				pw->state = SDMMC_POWER_FAILED;
+				break;
 		}
 	}
-	return blkcnt;
+	return TRUE;
 }
 
-static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
+/* Finishes a bring-up started by sdmmc_early_start(), or runs a new one */
+static bool sdmmc_power_up(sdhci_t *hci, sdmmc_t *card, sdmmc_power_t *pw)
+{
+	if (pw->state == SDMMC_POWER_OFF || pw->state == SDMMC_POWER_FAILED)
+		sdmmc_power_begin(card, pw);
+	while (!sdmmc_power_step(hci, card, pw))
+		sdmmc_wait_until(pw->next_us);
+	return pw->state == SDMMC_POWER_READY;
+}
+
+static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card, sdmmc_power_t *pw)
 {
 	sdhci_cmd_t	 cmd = {0};
 	sdhci_data_t dat = {0};
@@ -382,61 +1152,29 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 	uint32_t	 unit, time;
 	int			 width;
 	int			 status;
-
-	sdhci_reset(hci);
-	if (!sdhci_set_clock(hci, MMC_CLK_400K) || !sdhci_set_width(hci, MMC_BUS_WIDTH_1)) {
-		error("SMHC: set clock/width failed\r\n");
-		return FALSE;
-	}
-
-	if (!go_idle_state(hci)) {
-		error("SMHC: set idle state failed\r\n");
+	smhc_clk_t	 target	   = hci->clock_wanted;
+	bool		 want_hs400 = false;
+	bool		 want_es	= false;
+	bool		 have_ref	= false;
+	uint32_t	 phase;
+	uint64_t	 stamp;
+
+	card->cmd23	 = FALSE;
+	card->uhs	 = FALSE;
+	card->timing = "legacy";
+	hci->hs400	 = false;
+	if (!sdmmc_power_up(hci, card, pw))
 		return FALSE;
-	}
-	udelay(2000); // 1ms + 74 clocks @ 400KHz (185us)
+	pw->state = SDMMC_POWER_OFF; // consumed, a retry starts over from CMD0
+	stamp	  = time_us();
 
-// Both SD & MMC: try SD first
-// Otherwise there's only one media type if enabled
 #if CONFIG_BOOT_SDCARD
-	if (!sd_send_op_cond(hci, card)) {
-#if CONFIG_BOOT_MMC
-		sdhci_reset(hci);
-		sdhci_set_clock(hci, MMC_CLK_400K);
-		sdhci_set_width(hci, MMC_BUS_WIDTH_1);
-
-		if (!go_idle_state(hci)) {
-			error("SMHC: set idle state failed\r\n");
-			return FALSE;
-		}
-		udelay(2000); // 1ms + 74 clocks @ 400KHz (185us)
-
-		if (!mmc_send_op_cond(hci, card)) {
-			debug("SMHC: SD/MMC detect failed\r\n");
+	if ((card->version & SD_VERSION_SD) && !hci->isspi && (hci->caps & SMHC_CAP_UHS) && (card->ocr & OCR_S18R)) {
+		if (!sd_switch_voltage(hci, card)) {
+			error("SMHC: 1.8V signal voltage switch failed\r\n");
 			return FALSE;
 		}
-#else
-		debug("SMHC: SD detect failed\r\n");
-		return FALSE;
-#endif
-	}
-// Only MMC
-#elif CONFIG_BOOT_MMC
-	// // Workaround for eMMC starting in alternative boot mode
-	// sdhci_reset(hci);
-	// if (!sdhci_set_clock(hci, MMC_CLK_400K) || !sdhci_set_width(hci, MMC_BUS_WIDTH_1)) {
-	// 	error("SMHC: set clock/width failed\r\n");
-	// 	return FALSE;
-	// }
-
-	// if (!go_idle_state(hci)) {
-	// 	error("SMHC: set idle state failed\r\n");
-	// 	return FALSE;
-	// }
-	// udelay(2000); // 1ms + 74 clocks @ 400KHz (185us)
-
-	if (!mmc_send_op_cond(hci, card)) {
-		debug("SMHC: MMC detect failed\r\n");
-		return FALSE;
+		debug("SMHC: switched to 1.8V signalling\r\n");
 	}
 #endif
 
@@ -471,6 +1209,8 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 		card->cid[2] = cmd.response[2];
 		card->cid[3] = cmd.response[3];
 
+		card->cid_hash = sdmmc_cid_hash(card);
+
 		cmd.idx		 = SD_CMD_SEND_RELATIVE_ADDR;
 		cmd.arg		 = card->rca << 16;
 		cmd.resptype = MMC_RSP_R6;
@@ -499,6 +1239,11 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 			if (status < 0)
 				return FALSE;
 		} while (status != MMC_STATUS_TRAN);
+
+#if CONFIG_BOOT_SDCARD
+		if ((card->version & SD_VERSION_SD) && !sd_send_scr(hci, card))
+			warning("SMHC: SCR read failed, CMD23 disabled\r\n");
+#endif
 	}
 
 	if (card->version == MMC_VERSION_UNKNOWN) {
@@ -591,7 +1336,9 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 				break;
 		}
 		debug("SMHC: MMC version %s\r\n", strver);
+		card->cmd23 = TRUE; // mandatory since MMC 3.1
 	}
+	debug("SMHC: CMD23 %s\r\n", card->cmd23 ? "supported" : "not supported");
 
 	if (card->high_capacity) {
 		if (card->version & SD_VERSION_SD) {
@@ -608,6 +1355,7 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 	}
 	card->capacity *= 1 << UNSTUFF_BITS(card->csd, 80, 4);
 	debug("SMHC: capacity %.1fGB\r\n", (f32)((f64)card->capacity / (f64)1000000000.0));
+	sdmmc_stage_done(card, SDMMC_INIT_IDENT, &stamp);
 
 	if (hci->isspi) {
 		if (!sdhci_set_clock(hci, min(card->tran_speed, hci->clock_wanted)) || !sdhci_set_width(hci, MMC_BUS_WIDTH_1)) {
@@ -616,6 +1364,15 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 		}
 	} else {
 		if (card->version & SD_VERSION_SD) {
+			if (hci->width == MMC_BUS_WIDTH_8)
+				hci->width = MMC_BUS_WIDTH_4; // SD has no 8-bit mode
+#if CONFIG_BOOT_SDCARD
+			if (hci->clock_wanted >= MMC_CLK_50M) {
+				hci->clock_wanted = sd_select_bus_speed(hci, card);
+				if (hci->clock_wanted == MMC_CLK_25M)
+					warning("SMHC: card does not support high-speed, using 25MHz\r\n");
+			}
+#endif
 			if (hci->width == MMC_BUS_WIDTH_4)
 				width = 2;
 			else
@@ -653,6 +1410,26 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 
 			u8 card_type = card->extcsd[EXT_CSD_CARD_TYPE];
 			bool want_ddr = hci->clock_wanted == MMC_CLK_50M_DDR;
+			bool want_hs200 = false;
+
+			if (hci->clock_wanted >= MMC_CLK_100M) {
+				want_hs200 = (hci->caps & SMHC_CAP_MMC_HS200) && (card_type & EXT_CSD_CARD_TYPE_HS200) &&
+							 hci->width >= MMC_BUS_WIDTH_4;
+				want_hs400 = (hci->caps & SMHC_CAP_MMC_HS400) && (card_type & EXT_CSD_CARD_TYPE_HS400) &&
+							 hci->width == MMC_BUS_WIDTH_8;
+				want_es	   = want_hs400 && (hci->caps & SMHC_CAP_MMC_HS400_ES) &&
+						  (card->extcsd[EXT_CSD_STROBE_SUPPORT] & 1);
+				if (want_hs400 && !want_es && !want_hs200)
+					want_hs400 = false; // plain HS400 is entered from a tuned HS200
+				// Enhanced strobe goes straight from HS to HS400, no HS200 tuning
+				if (want_es)
+					want_hs200 = false;
+				if (!want_hs200) {
+					if (!want_es)
+						warning("SMHC: HS200 not available, using high-speed 52MHz\r\n");
+					hci->clock_wanted = MMC_CLK_50M;
+				}
+			}
 
 			if (want_ddr && !(card_type & EXT_CSD_CARD_TYPE_DDR_52)) {
 				warning("SMHC: controller requested DDR but card does not advertise DDR support, falling back to high-speed SDR\r\n");
@@ -660,65 +1437,81 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 				want_ddr = false;
 			}
 
-			if (hci->clock_wanted >= MMC_CLK_50M) {
+			if (hci->clock_wanted >= MMC_CLK_50M && !want_hs200) {
 				if (!(card_type & (EXT_CSD_CARD_TYPE_52 | EXT_CSD_CARD_TYPE_DDR_52))) {
 					warning("SMHC: card does not advertise high-speed timing, using 25MHz\r\n");
 					hci->clock_wanted = MMC_CLK_25M;
 					want_ddr = false;
 				} else {
-					cmd.idx		 = SD_CMD_SWITCH_FUNC;
-					cmd.resptype = MMC_RSP_R1;
-					cmd.arg		 = (3 << 24) | (EXT_CSD_HS_TIMING << 16) | (EXT_CSD_TIMING_HS << 8) | EXT_CSD_CMD_SET_NORMAL;
-					if (!sdhci_transfer(hci, &cmd, NULL))
+					if (!mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS))
 						return FALSE;
-					udelay(1000);
-					card->extcsd[EXT_CSD_HS_TIMING] = EXT_CSD_TIMING_HS;
+					card->timing = want_ddr ? "DDR52" : "HS52";
 				}
 			}
 
-			switch (hci->width) {
-				case MMC_BUS_WIDTH_4:
-					if (want_ddr)
-						width = EXT_CSD_DDR_BUS_WIDTH_4;
-					else
-						width = EXT_CSD_BUS_WIDTH_4;
-					break;
-				default:
-					width = EXT_CSD_BUS_WIDTH_1;
+			// Confirm the wide widths with a bus test, dropping 8 -> 4 -> 1 bit on failure
+			while (hci->width >= MMC_BUS_WIDTH_4) {
+				if (mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, mmc_bus_width(hci, false)) &&
+					sdhci_set_width(hci, hci->width) && mmc_bus_test(hci, card))
 					break;
+				warning("SMHC: %s bus test failed\r\n", hci->width == MMC_BUS_WIDTH_8 ? "8-bit" : "4-bit");
+				hci->width = hci->width == MMC_BUS_WIDTH_8 ? MMC_BUS_WIDTH_4 : MMC_BUS_WIDTH_1;
 			}
-
-			if (hci->width >= MMC_BUS_WIDTH_4) {
-				cmd.idx		 = SD_CMD_SWITCH_FUNC;
-				cmd.resptype = MMC_RSP_R1;
-				cmd.arg		 = (3 << 24) | (EXT_CSD_POWER_CLASS << 16) | EXT_CSD_CMD_SET_NORMAL;
-				if (width == EXT_CSD_DDR_BUS_WIDTH_4) {
-					cmd.arg |= ((card->extcsd[EXT_CSD_PWR_CL_DDR_52_360] &
-								 EXT_CSD_PWR_CL_4BIT_MASK >> EXT_CSD_PWR_CL_4BIT_SHIFT)
-								<< 8);
-				} else {
-					cmd.arg |=
-						((card->extcsd[EXT_CSD_PWR_CL_52_360] & EXT_CSD_PWR_CL_4BIT_MASK >> EXT_CSD_PWR_CL_4BIT_SHIFT)
-						 << 8);
-				}
-
-				if (!sdhci_transfer(hci, &cmd, NULL))
+			if (hci->width == MMC_BUS_WIDTH_1) {
+				if (!mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, EXT_CSD_BUS_WIDTH_1))
 					return FALSE;
+				if (want_ddr)
+					hci->clock_wanted = MMC_CLK_50M;
+				want_ddr   = false;
+				want_hs200 = false;
 			}
+			if (hci->width != MMC_BUS_WIDTH_8)
+				want_hs400 = want_es = false;
+			if (!want_hs200 && !want_es && hci->clock_wanted >= MMC_CLK_100M)
+				hci->clock_wanted = MMC_CLK_50M;
 
-			// Write EXT_CSD register 183 (width) with our value
-			cmd.idx		 = SD_CMD_SWITCH_FUNC;
-			cmd.resptype = MMC_RSP_R1;
-			cmd.arg		 = (3 << 24) | (EXT_CSD_BUS_WIDTH << 16) | (width << 8) | 1;
-			if (!sdhci_transfer(hci, &cmd, NULL))
+			// Untuned DDR modes are phase-checked against block 0, read here while the clock is slow
+			if (want_ddr || want_hs400)
+				have_ref = sdhci_probe_read(hci, MMC_READ_SINGLE_BLOCK, 0, phase_ref, sizeof(phase_ref));
+
+			if (hci->width >= MMC_BUS_WIDTH_4)
+				mmc_select_power_class(hci, card, want_ddr || want_hs400, want_hs200 || want_es);
+
+			width = mmc_bus_width(hci, want_ddr);
+			if (want_ddr && !mmc_switch(hci, card, EXT_CSD_BUS_WIDTH, width))
 				return FALSE;
 
-			udelay(1000);
+			// HS200 is selected after the bus width, then tuned at the final clock
+			if (want_hs200 && !mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS200)) {
+				warning("SMHC: HS200 switch failed, using high-speed 52MHz\r\n");
+				if (!mmc_switch(hci, card, EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS))
+					return FALSE;
+				hci->clock_wanted = MMC_CLK_50M;
+			}
 		}
+
+		phase = sdmmc_load_phase(hci);
+		if ((phase & 0xffff0000) == sdmmc_phase_key(card))
+			sdhci_set_phase(hci, phase & 0xffff);
+
 		if (!sdhci_set_clock(hci, hci->clock_wanted) || !sdhci_set_width(hci, hci->width)) {
 			error("SMHC: set clock/width failed\r\n");
 			return FALSE;
 		}
+
+#if CONFIG_BOOT_SDCARD
+		if ((card->version & SD_VERSION_SD) && hci->clock_active >= MMC_CLK_100M &&
+			!sdhci_execute_tuning(hci, SD_CMD_SEND_TUNING_BLOCK)) {
+			warning("SMHC: tuning failed, falling back to 50MHz\r\n");
+			if (!sdhci_set_clock(hci, MMC_CLK_50M))
+				return FALSE;
+		}
+#endif
+
+		if ((card->version & MMC_VERSION_MMC) && !mmc_select_timing(hci, card, target, want_hs400, want_es))
+			return FALSE;
+
+		sdmmc_update_phase(hci, card, have_ref);
 	}
 
 	cmd.idx		 = MMC_SET_BLOCKLEN;
@@ -727,8 +1520,318 @@ static bool sdmmc_detect(sdhci_t *hci, sdmmc_t *card)
 	if (!sdhci_transfer(hci, &cmd, NULL))
 		return FALSE;
 
+	sdmmc_stage_done(card, SDMMC_INIT_BUS, &stamp);
+	return TRUE;
+}
+
+uint64_t sdmmc_blk_submit(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint64_t blkcnt)
+{
+	sdmmc_t *sdcard = &data->card;
+	uint64_t max	= sdhci_max_blkcnt(data->hci, sdcard->read_bl_len);
+
+	if (sdcard->cmd23 && max > SDMMC_SBC_MAX_BLKCNT)
+		max = SDMMC_SBC_MAX_BLKCNT;
+	if (blkcnt > max)
+		blkcnt = max;
+
+	if (blkcnt == 0 || !sdmmc_start_read(data, buf, blkno, blkcnt))
+		return 0;
+	return blkcnt;
+}
+
+int sdmmc_blk_poll(sdmmc_pdata_t *data)
+{
+	sdmmc_t *sdcard = &data->card;
+	int		 ret;
+
+	if (data->hci->xfer.dat != &data->xfer_dat)
+		return SDHCI_XFER_DONE;
+
+	ret = sdhci_poll(data->hci);
+	if (ret == SDHCI_XFER_ERROR) {
+		warning("SMHC: read failed\r\n");
+	} else if (ret == SDHCI_XFER_DONE) {
+		/*
+		 * The controller only reports success once the data phase and, for
+		 * multi-block reads, the auto-stop or CMD23 count have completed
+		 * without error, so the card is already back in TRAN: no CMD13 poll
+		 * and no separate stop wait are needed.
+		 */
+		sdcard->stats.status_skipped++;
+		if (data->xfer_dat.blkcnt > 1)
+			sdcard->stats.stop_skipped++;
+	}
+	return ret;
+}
+
+bool sdmmc_blk_wait(sdmmc_pdata_t *data)
+{
+	int ret;
+
+	do {
+		ret = sdmmc_blk_poll(data);
+	} while (ret == SDHCI_XFER_BUSY);
+
+	return ret == SDHCI_XFER_DONE;
+}
+
+#if CONFIG_BOOT_MMC && CONFIG_MMC_CMDQ
+#define MMC_CMDQ_MAX_BLKCNT	  0xffff /* CMD44 block count field */
+#define MMC_CMDQ_DISCARD_ALL  1 /* CMD48 TM op-code */
+#define MMC_CMDQ_STATUS_QUEUE (1 << 15) /* CMD13 returns the Queue Status Register */
+
+/* Task slots the driver may use on this card, 0 without a command queue */
+static uint32_t mmc_cmdq_depth(sdmmc_pdata_t *data)
+{
+	sdmmc_t *card = &data->card;
+	uint32_t depth;
+
+	if (data->hci->isspi || !(card->version & MMC_VERSION_MMC) || card->extcsd[EXT_CSD_REV] < 8 ||
+		!(card->extcsd[EXT_CSD_CMDQ_SUPPORT] & 1))
+		return 0;
+	depth = (card->extcsd[EXT_CSD_CMDQ_DEPTH] & 0x1f) + 1;
+	return depth < SDMMC_CMDQ_TASKS ? depth : SDMMC_CMDQ_TASKS;
+}
+
+static bool mmc_cmdq_enable(sdmmc_pdata_t *data, bool on)
+{
+	if (data->cmdq_on == on)
+		return TRUE;
+	if (!mmc_switch(data->hci, &data->card, EXT_CSD_CMDQ_MODE_EN, on))
+		return FALSE;
+	data->cmdq_on = on;
+	debug("SMHC: %s command queue %s\r\n", data->hci->name, on ? "on" : "off");
+	return TRUE;
+}
+
+/* CMD44 and CMD45: the card starts fetching the task as soon as it has both */
+static bool mmc_cmdq_queue(sdmmc_pdata_t *data, int task, uint8_t *buf, uint32_t blkno, uint32_t blkcnt)
+{
+	sdmmc_t	   *card = &data->card;
+	sdhci_cmd_t cmd	 = {0};
+
+	cmd.idx		 = MMC_QUE_TASK_PARAMS;
+	cmd.arg		 = (1 << 30) | (task << 16) | blkcnt; // read
+	cmd.resptype = MMC_RSP_R1;
+	card->stats.cmds++;
+	if (!sdhci_transfer(data->hci, &cmd, NULL))
+		return FALSE;
+
+	cmd.idx = MMC_QUE_TASK_ADDR;
+	cmd.arg = card->high_capacity ? blkno : blkno * card->read_bl_len;
+	card->stats.cmds++;
+	if (!sdhci_transfer(data->hci, &cmd, NULL))
+		return FALSE;
+
+	data->tasks[task].buf	 = buf;
+	data->tasks[task].blkno	 = blkno;
+	data->tasks[task].blkcnt = blkcnt;
+	data->queued |= 1 << task;
+	return TRUE;
+}
+
+/* Starts the data phase of a task the card reports ready, in whatever order they became ready */
+static int mmc_cmdq_execute(sdmmc_pdata_t *data)
+{
+	sdmmc_t		 *card = &data->card;
+	sdhci_cmd_t	 *cmd  = &data->xfer_cmd;
+	sdhci_data_t *dat  = &data->xfer_dat;
+	sdhci_cmd_t	  qsr  = {0};
+	uint32_t	  ready;
+	int			  task;
+
+	qsr.idx		 = MMC_SEND_STATUS;
+	qsr.arg		 = (card->rca << 16) | MMC_CMDQ_STATUS_QUEUE;
+	qsr.resptype = MMC_RSP_R1;
+	card->stats.cmds++;
+	if (!sdhci_transfer(data->hci, &qsr, NULL))
+		return SDHCI_XFER_ERROR;
+	ready = qsr.response[0] & data->queued;
+	if (!ready)
+		return SDHCI_XFER_BUSY;
+
+	for (task = 0; !(ready & (1 << task)); task++) {
+	}
+	cmd->idx	  = MMC_EXECUTE_READ_TASK;
+	cmd->arg	  = task << 16;
+	cmd->resptype = MMC_RSP_R1;
+	dat->buf	  = data->tasks[task].buf;
+	dat->flag	  = MMC_DATA_READ | MMC_DATA_SBC; // the length is known from CMD44, no stop
+	dat->blksz	  = card->read_bl_len;
+	dat->blkcnt	  = data->tasks[task].blkcnt;
+
+	card->stats.reads++;
+	card->stats.cmds++;
+	if (!sdhci_submit(data->hci, cmd, dat)) {
+		warning("SMHC: CMDQ task %d failed\r\n", task);
+		return SDHCI_XFER_ERROR;
+	}
+	data->queued &= ~(1 << task);
+	data->executing = 1 << task;
+	return SDHCI_XFER_BUSY;
+}
+
+/* Drops whatever is still queued and leaves CMDQ mode so that CMD17/CMD18 work again */
+static void mmc_cmdq_abort(sdmmc_pdata_t *data)
+{
+	sdhci_cmd_t cmd = {0};
+
+	if (data->executing)
+		sdhci_wait(data->hci);
+	if (data->queued) {
+		cmd.idx		 = MMC_CMDQ_TASK_MGMT;
+		cmd.arg		 = MMC_CMDQ_DISCARD_ALL;
+		cmd.resptype = MMC_RSP_R1B;
+		sdhci_transfer(data->hci, &cmd, NULL);
+	}
+	data->queued	= 0;
+	data->executing = 0;
+	mmc_cmdq_enable(data, FALSE);
+}
+
+/*
+ * One step of the reads of a CMDQ card: its runs are cut into tasks and
+ * queued whenever the data lines are idle, so that the card can fetch the
+ * next tasks while it transfers the one it reported ready. Queue commands
+ * are not sent during a transfer, the SMHC has a single command path.
+ */
+static int mmc_cmdq_step(sdmmc_pdata_t *data, sdmmc_run_t *runs, int count)
+{
+	sdmmc_t *card  = &data->card;
+	int		 depth = mmc_cmdq_depth(data);
+	uint32_t max   = sdhci_max_blkcnt(data->hci, card->read_bl_len);
+	uint32_t n;
+	int		 i, task = 0, ret;
+
+	if (data->executing) {
+		ret = sdhci_poll(data->hci);
+		if (ret == SDHCI_XFER_BUSY)
+			return ret;
+		data->executing = 0;
+		if (ret == SDHCI_XFER_ERROR)
+			goto fail;
+		card->stats.status_skipped++;
+	}
+
+	if (max > MMC_CMDQ_MAX_BLKCNT)
+		max = MMC_CMDQ_MAX_BLKCNT;
+	for (i = 0; i < count; i++) {
+		sdmmc_run_t *run = &runs[i];
+
+		while (run->data == data && run->blkcnt) {
+			while (task < depth && (data->queued & (1 << task)))
+				task++;
+			if (task == depth)
+				break;
+			if (!mmc_cmdq_enable(data, TRUE))
+				goto fail;
+
+			n = run->blkcnt < max ? run->blkcnt : max;
+			if (!mmc_cmdq_queue(data, task, run->buf, run->blkno, n))
+				goto fail;
+			run->buf += n * card->read_bl_len;
+			run->blkno += n;
+			run->blkcnt -= n;
+		}
+	}
+
+	if (!data->queued)
+		return mmc_cmdq_enable(data, FALSE) ? SDHCI_XFER_DONE : SDHCI_XFER_ERROR;
+	ret = mmc_cmdq_execute(data);
+	if (ret == SDHCI_XFER_ERROR)
+		goto fail;
+	return ret;
+
+fail:
+	warning("SMHC: CMDQ read failed\r\n");
+	mmc_cmdq_abort(data);
+	return SDHCI_XFER_ERROR;
+}
+
+/* The first run of its card */
+static bool sdmmc_run_first(const sdmmc_run_t *runs, int i)
+{
+	int j;
+
+	for (j = 0; j < i; j++) {
+		if (runs[j].data == runs[i].data)
+			return FALSE;
+	}
 	return TRUE;
 }
+#endif
+
+/* Runs on one card go in order, a run waits until the earlier ones of its card are done */
+static bool sdmmc_run_blocked(const sdmmc_run_t *runs, int i)
+{
+	int j;
+
+	for (j = 0; j < i; j++) {
+		if (runs[j].data == runs[i].data && runs[j].blkcnt)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+int sdmmc_read_runs(sdmmc_run_t *runs, int count)
+{
+	uint64_t inflight[SDMMC_MAX_RUNS] = {0};
+	bool	 failed					  = FALSE;
+	int		 i, ret, busy;
+
+	if (count > SDMMC_MAX_RUNS)
+		return -1;
+
+	do {
+		busy = 0;
+		for (i = 0; i < count; i++) {
+			sdmmc_run_t *run = &runs[i];
+
+#if CONFIG_BOOT_MMC && CONFIG_MMC_CMDQ
+			// All runs of a CMDQ card are stepped together, from its first run
+			if (mmc_cmdq_depth(run->data)) {
+				if (!sdmmc_run_first(runs, i))
+					continue;
+				if (failed) {
+					mmc_cmdq_abort(run->data);
+					continue;
+				}
+				ret = mmc_cmdq_step(run->data, runs, count);
+				if (ret == SDHCI_XFER_BUSY)
+					busy++;
+				else if (ret == SDHCI_XFER_ERROR)
+					failed = TRUE;
+				continue;
+			}
+#endif
+			if (inflight[i]) {
+				ret = sdmmc_blk_poll(run->data);
+				if (ret == SDHCI_XFER_BUSY) {
+					busy++;
+					continue;
+				}
+				if (ret == SDHCI_XFER_ERROR) {
+					failed = TRUE;
+				} else {
+					run->buf += inflight[i] * run->data->card.read_bl_len;
+					run->blkno += inflight[i];
+					run->blkcnt -= inflight[i];
+				}
+				inflight[i] = 0;
+			}
+			if (failed || run->blkcnt == 0 || sdmmc_run_blocked(runs, i))
+				continue;
+
+			inflight[i] = sdmmc_blk_submit(run->data, run->buf, run->blkno, run->blkcnt);
+			if (inflight[i] == 0)
+				failed = TRUE;
+			else
+				busy++;
+		}
+	} while (busy);
+
+	return failed ? -1 : 0;
+}
 
 uint64_t sdmmc_blk_read(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint64_t blkcnt)
 {
@@ -736,8 +1839,8 @@ uint64_t sdmmc_blk_read(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint6
 	sdmmc_t *sdcard = &data->card;
 
 	while (blks > 0) {
-		cnt = (blks > 127) ? 127 : blks;
-		if (sdmmc_read_blocks(data->hci, sdcard, buf, blkno, cnt) != cnt)
+		cnt = sdmmc_blk_submit(data, buf, blkno, blks);
+		if (cnt == 0 || !sdmmc_blk_wait(data))
 			return 0;
 		blks -= cnt;
 		blkno += cnt;
@@ -746,19 +1849,137 @@ uint64_t sdmmc_blk_read(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint6
 	return blkcnt;
 }
 
+/*
+ * CMD24 per block, each waited for until the card leaves PRG. Only small
+ * records are written, a multi-block path would not pay off.
+ */
+uint64_t sdmmc_blk_write(sdmmc_pdata_t *data, const uint8_t *buf, uint64_t blkno, uint64_t blkcnt)
+{
+	sdmmc_t		*card	= &data->card;
+	sdhci_cmd_t	 cmd	= {0};
+	sdhci_cmd_t	 status = {0};
+	sdhci_data_t dat	= {0};
+	sdmmc_poll_t poll;
+	uint64_t	 i;
+
+	status.idx		= MMC_SEND_STATUS;
+	status.resptype = MMC_RSP_R1;
+	status.arg		= card->rca << 16;
+
+	for (i = 0; i < blkcnt; i++) {
+		cmd.idx		 = MMC_WRITE_SINGLE_BLOCK;
+		cmd.arg		 = card->high_capacity ? blkno + i : (blkno + i) * card->write_bl_len;
+		cmd.resptype = MMC_RSP_R1;
+		dat.buf		 = (uint8_t *)buf + i * card->write_bl_len;
+		dat.flag	 = MMC_DATA_WRITE;
+		dat.blksz	 = card->write_bl_len;
+		dat.blkcnt	 = 1;
+		card->stats.cmds++;
+		if (!sdhci_transfer(data->hci, &cmd, &dat)) {
+			warning("SMHC: write of block %" PRIu32 " failed\r\n", (uint32_t)(blkno + i));
+			return i;
+		}
+
+		sdmmc_poll_start(&poll, SDMMC_WRITE_TIMEOUT_US);
+		do {
+			if (!sdhci_transfer(data->hci, &status, NULL))
+				continue;
+			if (((status.response[0] >> 9) & 0xf) != MMC_STATUS_PRG)
+				break;
+		} while (sdmmc_poll_wait(&poll));
+		if (poll.expired || (status.response[0] & 0xfff80000)) {
+			warning("SMHC: write of block %" PRIu32 " failed (status 0x%08" PRIx32 ")\r\n", (uint32_t)(blkno + i),
+					status.response[0]);
+			return i;
+		}
+	}
+	return blkcnt;
+}
+
+bool sdmmc_select_part(sdmmc_pdata_t *data, uint8_t part)
+{
+	sdmmc_t *card	= &data->card;
+	uint8_t	 config = card->extcsd[EXT_CSD_PART_CONFIG];
+
+	if (!(card->version & MMC_VERSION_MMC))
+		return part == MMC_PART_USER;
+	if ((config & EXT_CSD_PART_ACCESS_MASK) == part)
+		return TRUE;
+
+	if (!mmc_switch(data->hci, card, EXT_CSD_PART_CONFIG, (config & ~EXT_CSD_PART_ACCESS_MASK) | part)) {
+		error("SMHC: cannot select partition %u\r\n", part);
+		return FALSE;
+	}
+	debug("SMHC: partition %u selected\r\n", part);
+	return TRUE;
+}
+
+/* The boot partition enabled in PARTITION_CONFIG, boot0 when none or the user area is */
+uint8_t sdmmc_boot_part(sdmmc_pdata_t *data)
+{
+	uint8_t enabled = (data->card.extcsd[EXT_CSD_PART_CONFIG] & EXT_CSD_BOOT_PART_MASK) >> EXT_CSD_BOOT_PART_SHIFT;
+
+	return enabled == MMC_PART_BOOT1 ? MMC_PART_BOOT1 : MMC_PART_BOOT0;
+}
+
+uint32_t sdmmc_part_blocks(sdmmc_pdata_t *data, uint8_t part)
+{
+	sdmmc_t *card = &data->card;
+
+	if (part == MMC_PART_USER)
+		return (uint32_t)(card->capacity / card->read_bl_len);
+	if (!(card->version & MMC_VERSION_MMC) || (part != MMC_PART_BOOT0 && part != MMC_PART_BOOT1))
+		return 0;
+	return card->extcsd[EXT_CSD_BOOT_MULT] * (128 * 1024 / 512); // BOOT_MULT counts 128KB units
+}
+
+void sdmmc_early_start(sdmmc_pdata_t *data, sdhci_t *hci)
+{
+	data->hci = hci;
+	// CMD0 would reset a card that sdmmc_init() can resume as it is
+	if (sdmmc_cache_valid(hci))
+		return;
+	sdmmc_power_begin(&data->card, &data->power);
+	sdmmc_power_step(hci, &data->card, &data->power);
+}
+
+void sdmmc_early_poll(sdmmc_pdata_t *data)
+{
+	if (data->power.state != SDMMC_POWER_OFF)
+		sdmmc_power_step(data->hci, &data->card, &data->power);
+}
+
 int sdmmc_init(sdmmc_pdata_t *data, sdhci_t *hci)
 {
 	data->hci	 = hci;
 	data->online = FALSE;
-	int retries	 = 10;
+	sdmmc_poll_t poll;
+	// A card already sent through CMD0 by sdmmc_early_start() has nothing left to resume
+	bool resumed = data->power.state == SDMMC_POWER_OFF && sdmmc_resume(data->hci, &data->card);
 
+	sdmmc_poll_start(&poll, SDMMC_INIT_TIMEOUT_US);
 	do {
-		if (sdmmc_detect(data->hci, &data->card) == TRUE) {
-			info("SHMC: %s card detected\r\n", data->card.version & SD_VERSION_SD ? "SD" : "MMC");
+		if (resumed || sdmmc_detect(data->hci, &data->card, &data->power) == TRUE) {
+			sdhci_t *hci  = data->hci;
+			u32		 bits = hci->width == MMC_BUS_WIDTH_8 ? 8 : hci->width == MMC_BUS_WIDTH_4 ? 4 : 1;
+			u32		 ddr  = (hci->clock_active == MMC_CLK_50M_DDR || hci->hs400) ? 2 : 1;
+
+			if (!resumed) {
+				// One RTC record, kept for the boot card
+				if (data == &card0)
+					sdmmc_save_cache(hci, &data->card);
+				debug("SMHC: init power %" PRIu32 "us, ocr %" PRIu32 "us, ident %" PRIu32 "us, bus %" PRIu32 "us\r\n",
+					  data->card.init_us[SDMMC_INIT_POWER], data->card.init_us[SDMMC_INIT_OCR],
+					  data->card.init_us[SDMMC_INIT_IDENT], data->card.init_us[SDMMC_INIT_BUS]);
+			}
+			info("SHMC: %s card detected on %s%s\r\n", data->card.version & SD_VERSION_SD ? "SD" : "MMC", hci->name,
+				 resumed ? " (warm)" : "");
+			info("SMHC: %s, %" PRIu32 "-bit at %" PRIu32 "MHz, %" PRIu32 "MB/s bus\r\n", data->card.timing, bits,
+				 hci->bus_hz / 1000000, (hci->bus_hz / 1000000) * bits * ddr / 8);
+			data->online = TRUE;
 			return 0;
 		}
-		mdelay(100);
-	} while (retries--);
+	} while (sdmmc_poll_wait(&poll));
 
 	return -1;
 }
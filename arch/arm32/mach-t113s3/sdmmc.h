@@ -18,6 +18,7 @@ enum {
 	MMC_READ_DAT_UNTIL_STOP = 11,
 	MMC_STOP_TRANSMISSION	= 12,
 	MMC_SEND_STATUS			= 13,
+	MMC_BUS_TEST_R			= 14,
 	MMC_GO_INACTIVE_STATE	= 15,
 	MMC_SPI_READ_OCR		= 58,
 	MMC_SPI_CRC_ON_OFF		= 59,
@@ -26,6 +27,8 @@ enum {
 	MMC_SET_BLOCKLEN		= 16,
 	MMC_READ_SINGLE_BLOCK	= 17,
 	MMC_READ_MULTIPLE_BLOCK = 18,
+	MMC_BUS_TEST_W			= 19,
+	MMC_SEND_TUNING_BLOCK_HS200 = 21,
 
 	/* Class 3 */
 	MMC_WRITE_DAT_UNTIL_STOP = 20,
@@ -57,12 +60,21 @@ enum {
 	/* Class 9 */
 	MMC_FAST_IO		 = 39,
 	MMC_GO_IRQ_STATE = 40,
+
+	/* Class 11 */
+	MMC_QUE_TASK_PARAMS	   = 44,
+	MMC_QUE_TASK_ADDR	   = 45,
+	MMC_EXECUTE_READ_TASK  = 46,
+	MMC_EXECUTE_WRITE_TASK = 47,
+	MMC_CMDQ_TASK_MGMT	   = 48,
 };
 
 enum {
 	SD_CMD_SEND_RELATIVE_ADDR = 3,
 	SD_CMD_SWITCH_FUNC		  = 6,
 	SD_CMD_SEND_IF_COND		  = 8,
+	SD_CMD_SWITCH_UHS18V	  = 11,
+	SD_CMD_SEND_TUNING_BLOCK  = 19,
 	SD_CMD_APP_SET_BUS_WIDTH  = 6,
 	SD_CMD_ERASE_WR_BLK_START = 32,
 	SD_CMD_ERASE_WR_BLK_END	  = 33,
@@ -107,6 +119,7 @@ enum {
 enum {
 	OCR_BUSY		 = 0x80000000,
 	OCR_HCS			 = 0x40000000,
+	OCR_S18R		 = 0x01000000, /* S18R in ACMD41, S18A in its response */
 	OCR_VOLTAGE_MASK = 0x00ffff80,
 	OCR_ACCESS_MODE	 = 0x60000000,
 };
@@ -114,6 +127,7 @@ enum {
 enum {
 	MMC_DATA_READ  = (1 << 0),
 	MMC_DATA_WRITE = (1 << 1),
+	MMC_DATA_SBC   = (1 << 2), /* block count set by CMD23, no auto-stop */
 };
 
 enum {
@@ -124,6 +138,7 @@ enum {
 enum {
 	MMC_BUS_WIDTH_1 = 1,
 	MMC_BUS_WIDTH_4 = 2,
+	MMC_BUS_WIDTH_8 = 3,
 };
 
 enum {
@@ -148,12 +163,31 @@ enum {
 	MMC_VERSION_5_1		= (MMC_VERSION_MMC | 0x501),
 };
 
+typedef struct {
+	uint32_t reads; /* CMD17/CMD18 issued */
+	uint32_t cmds; /* every command sent by the read path, CMD23 included */
+	uint32_t sbc_reads; /* multi-block reads bounded by CMD23 */
+	uint32_t status_skipped; /* CMD13 polls not needed after a completed read */
+	uint32_t stop_skipped; /* stop waits not needed after auto-stop or CMD23 */
+} sdmmc_stats_t;
+
+/* Stages of the card bring-up, timed into sdmmc_t.init_us */
+enum {
+	SDMMC_INIT_POWER = 0, /* clock start and CMD0 */
+	SDMMC_INIT_OCR, /* ACMD41 / CMD1 until the card is ready */
+	SDMMC_INIT_IDENT, /* CID, RCA, CSD and card select */
+	SDMMC_INIT_BUS, /* bus width, timing and tuning */
+	SDMMC_INIT_STAGES,
+};
+
 typedef struct {
 	uint32_t version;
 	uint32_t ocr;
 	uint32_t rca;
 	uint32_t cid[4];
+	uint16_t cid_hash; /* keys the RTC records of this card */
 	uint32_t csd[4];
+	uint32_t scr[2];
 	uint8_t	 extcsd[512];
 
 	uint32_t high_capacity;
@@ -162,18 +196,116 @@ typedef struct {
 	uint32_t read_bl_len;
 	uint32_t write_bl_len;
 	uint64_t capacity;
+	bool	 cmd23;
+	bool	 uhs; /* signalling at 1.8V after CMD11 */
+	const char *timing; /* negotiated bus timing, for the log */
+	uint32_t	init_us[SDMMC_INIT_STAGES]; /* time spent in each stage of the last full init */
+
+	sdmmc_stats_t stats;
 } sdmmc_t;
 
+/* Card bring-up up to the end of the OCR handshake */
+enum {
+	SDMMC_POWER_OFF = 0,
+	SDMMC_POWER_RESET, /* host reset, 400KHz clock started */
+	SDMMC_POWER_IDLE, /* waiting to send CMD0 */
+	SDMMC_POWER_SD_OCR, /* ACMD41 until the card leaves busy */
+	SDMMC_POWER_MMC_OCR, /* CMD1 until the card leaves busy */
+	SDMMC_POWER_READY,
+	SDMMC_POWER_FAILED,
+};
+
+typedef struct {
+	int		 state;
+	int		 media; /* SDMMC_POWER_SD_OCR or SDMMC_POWER_MMC_OCR */
+	uint64_t next_us; /* earliest time of the next step */
+	uint64_t deadline; /* of the OCR handshake */
+	uint32_t wait; /* OCR poll backoff */
+	uint64_t stamp; /* start of the stage being timed */
+} sdmmc_power_t;
+
+#define SDMMC_CMDQ_TASKS 16 /* eMMC command queue slots used, the card may have more */
+
+typedef struct {
+	uint8_t *buf;
+	uint32_t blkno;
+	uint32_t blkcnt;
+} sdmmc_task_t;
+
 typedef struct {
 	sdmmc_t	 card;
 	sdhci_t *hci;
 	uint8_t	 buf[512];
 	bool	 online;
+
+	sdhci_cmd_t	 xfer_cmd; /* in-flight read started by sdmmc_blk_submit() */
+	sdhci_data_t xfer_dat;
+
+	sdmmc_power_t power; /* bring-up in progress, see sdmmc_early_start() */
+
+#if CONFIG_BOOT_MMC && CONFIG_MMC_CMDQ
+	sdmmc_task_t tasks[SDMMC_CMDQ_TASKS]; /* CMDQ reads queued by sdmmc_read_runs() */
+	uint32_t	 queued; /* tasks sent with CMD44/CMD45, not yet executed */
+	uint32_t	 executing; /* task whose CMD46 is in flight */
+	bool		 cmdq_on; /* EXT_CSD CMDQ_MODE_EN set */
+#endif
 } sdmmc_pdata_t;
 
+/* eMMC hardware partitions, EXT_CSD PARTITION_CONFIG access field */
+enum {
+	MMC_PART_USER  = 0,
+	MMC_PART_BOOT0 = 1,
+	MMC_PART_BOOT1 = 2,
+};
+
 extern sdmmc_pdata_t card0;
+#if CONFIG_SDMMC_CARD1
+extern sdmmc_pdata_t card1;
+#endif
 
 int		 sdmmc_init(sdmmc_pdata_t *data, sdhci_t *hci);
+
+/*
+ * Split-phase bring-up: sdmmc_early_start() resets the card and starts the
+ * OCR handshake without blocking or touching DRAM, sdmmc_early_poll() sends
+ * whatever command is due and returns at once. sdmmc_init() then picks up
+ * from wherever the handshake got to.
+ */
+void sdmmc_early_start(sdmmc_pdata_t *data, sdhci_t *hci);
+void sdmmc_early_poll(sdmmc_pdata_t *data);
 uint64_t sdmmc_blk_read(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint64_t blkcnt);
+uint64_t sdmmc_blk_write(sdmmc_pdata_t *data, const uint8_t *buf, uint64_t blkno, uint64_t blkcnt);
+
+/*
+ * Non-blocking reads: submit starts one command (clamped to what a single
+ * command can carry) and returns the number of blocks in flight, 0 on error.
+ * Poll returns SDHCI_XFER_BUSY/DONE/ERROR; only one read per card at a time.
+ */
+uint64_t sdmmc_blk_submit(sdmmc_pdata_t *data, uint8_t *buf, uint64_t blkno, uint64_t blkcnt);
+int		 sdmmc_blk_poll(sdmmc_pdata_t *data);
+bool	 sdmmc_blk_wait(sdmmc_pdata_t *data);
+
+/*
+ * Reads several block runs together, keeping a command in flight on every
+ * card involved so that their IDMA transfers overlap. Runs on the same card
+ * are read in order, except on an eMMC with a command queue: there they are
+ * all queued as CMDQ tasks and the card picks the order. Returns 0 once all
+ * runs are in memory.
+ */
+typedef struct {
+	sdmmc_pdata_t *data;
+	uint8_t		  *buf;
+	uint64_t	   blkno;
+	uint64_t	   blkcnt;
+} sdmmc_run_t;
+
+#define SDMMC_MAX_RUNS 8
+
+int sdmmc_read_runs(sdmmc_run_t *runs, int count);
+
+/* Partition switching, the user area is the only partition on SD cards */
+bool	 sdmmc_select_part(sdmmc_pdata_t *data, uint8_t part);
+uint8_t	 sdmmc_boot_part(sdmmc_pdata_t *data);
+uint32_t sdmmc_part_blocks(sdmmc_pdata_t *data, uint8_t part);
 
 #endif /* __SDCARD_H__ */
@@ -28,6 +28,7 @@
 #include "reg-ccu.h"
 #include "board.h"
 #include "io.h"
+#include <asm/cache.h>
 
 #define SUNXI_DMA_MAX 16
 
@@ -189,6 +190,7 @@ int dma_start(u32 hdma, u32 saddr, u32 daddr, u32 bytes)
 	desc->source_addr = saddr;
 	desc->dest_addr	  = daddr;
 	desc->byte_count  = bytes;
+	flush_dcache_range((unsigned long)desc, (unsigned long)(desc + 1));
 
 	/* start dma */
 	channel->desc_addr = (u32)desc;
@@ -270,6 +272,9 @@ int dma_test()
 		src_addr[i + 3] = i + 3;
 	}
 
+	flush_dcache_range((unsigned long)src_addr, (unsigned long)src_addr + len);
+	flush_dcache_range((unsigned long)dst_addr, (unsigned long)dst_addr + len);
+
 	/* timeout : 100 ms */
 	timeout = time_ms();
 
@@ -287,6 +292,7 @@ int dma_test()
 
 		return -2;
 	} else {
+		invalidate_dcache_range((unsigned long)dst_addr, (unsigned long)dst_addr + len);
 		valid = 1;
 		// Check data is valid
 		for (i = 0; i < (len / 4); i += 4) {
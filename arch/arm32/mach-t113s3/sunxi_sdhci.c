@@ -33,11 +33,35 @@
 #include "sunxi_sdhci.h"
 #include "sunxi_gpio.h"
 #include "sunxi_clk.h"
+#include "board.h"
+#include <asm/cache.h>
 
 #define FALSE 0
 #define TRUE  1
 
-static int config_delay(sdhci_t *sdhci);
+static int	 config_delay(sdhci_t *sdhci);
+static int	 calibrate_delay(volatile u32 *reg, const char *name);
+static bool update_card_clock(sdhci_t *sdhci);
+
+/* CMD19/CMD21 tuning block on a 4-bit bus */
+static const u8 tuning_blk_pattern_4bit[64] = {
+	0xff, 0x0f, 0xff, 0x00, 0xff, 0xcc, 0xc3, 0xcc, 0xc3, 0x3c, 0xcc, 0xff, 0xfe, 0xff, 0xfe, 0xef,
+	0xff, 0xdf, 0xff, 0xdd, 0xff, 0xfb, 0xff, 0xfb, 0xbf, 0xff, 0x7f, 0xff, 0x77, 0xf7, 0xbd, 0xef,
+	0xff, 0xf0, 0xff, 0xf0, 0x0f, 0xfc, 0xcc, 0x3c, 0xcc, 0x33, 0xcc, 0xcf, 0xff, 0xef, 0xff, 0xee,
+	0xff, 0xfd, 0xff, 0xfd, 0xdf, 0xff, 0xbf, 0xff, 0xbb, 0xff, 0xf7, 0xff, 0xf7, 0x7f, 0x7b, 0xde,
+};
+
+/* CMD21 tuning block on an 8-bit bus */
+static const u8 tuning_blk_pattern_8bit[128] = {
+	0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00, 0x00, 0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc, 0xcc,
+	0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff, 0xff, 0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee, 0xff,
+	0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd, 0xdd, 0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff, 0xbb,
+	0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff, 0xff, 0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee, 0xff,
+	0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00, 0x00, 0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc,
+	0xcc, 0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff, 0xff, 0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee,
+	0xff, 0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd, 0xdd, 0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff,
+	0xbb, 0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff, 0xff, 0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee,
+};
 
 /*
  * Global control register bits
@@ -69,6 +93,7 @@ static int config_delay(sdhci_t *sdhci);
  */
 #define SMHC_WIDTH_1BIT (0)
 #define SMHC_WIDTH_4BIT (1)
+#define SMHC_WIDTH_8BIT (2)
 
 /*
  * Smc command bits
@@ -327,6 +352,12 @@ static int prepare_dma(sdhci_t *sdhci, sdhci_data_t *data)
 	else
 		remain = SMHC_DES_BUFFER_MAX_LEN - 1;
 
+	if (buff_frag_num > sdhci->dma_desc_num) {
+		error("SMHC: %" PRIu32 " bytes need %" PRIu32 " descriptors, pool has %" PRIu32 "\r\n", byte_cnt, buff_frag_num,
+			  sdhci->dma_desc_num);
+		return -1;
+	}
+
 	for (i = 0; i < buff_frag_num; i++, des_idx++) {
 		memset((void *)&pdes[des_idx], 0, sizeof(sdhci_idma_desc_t));
 		pdes[des_idx].des_chain = 1;
@@ -353,6 +384,10 @@ static int prepare_dma(sdhci_t *sdhci, sdhci_data_t *data)
 			  (u32)((u32 *)&pdes[des_idx])[1], (u32)((u32 *)&pdes[des_idx])[2], (u32)((u32 *)&pdes[des_idx])[3]);
 	}
 
+	/* The IDMA fetches descriptors and data straight from memory */
+	flush_dcache_range((unsigned long)pdes, (unsigned long)&pdes[des_idx]);
+	flush_dcache_range((unsigned long)data->buf, (unsigned long)data->buf + byte_cnt);
+
 	wmb();
 
 	/*
@@ -388,7 +423,15 @@ static int prepare_dma(sdhci_t *sdhci, sdhci_data_t *data)
 	return 0;
 }
 
-static int wait_done(sdhci_t *sdhci, sdhci_data_t *dat, u32 timeout_msecs, u32 flag, bool dma, u32 *status_out)
+/* Multi-block transfers end with the auto-stop unless CMD23 already bounded them */
+static u32 data_done_flag(sdhci_data_t *dat)
+{
+	if (dat->blkcnt > 1 && !(dat->flag & MMC_DATA_SBC))
+		return SMHC_RINT_AUTO_COMMAND_DONE;
+	return SMHC_RINT_DATA_OVER;
+}
+
+static int wait_done(sdhci_t *sdhci, u32 timeout_msecs, u32 flag, u32 *status_out)
 {
 	u32 status;
 	u32 done  = 0;
@@ -405,10 +448,7 @@ static int wait_done(sdhci_t *sdhci, sdhci_data_t *dat, u32 timeout_msecs, u32 f
 				*status_out = status;
 			return -1;
 		}
-		if (dat && dma && (dat->blkcnt * dat->blksz) > 0)
-			done = ((status & flag) && (sdhci->reg->idst & SMHC_IDMAC_RECEIVE_INTERRUPT)) ? 1 : 0;
-		else
-			done = (status & flag);
+		done = (status & flag);
 	} while (!done);
 
 	if (status_out)
@@ -457,10 +497,7 @@ static bool read_bytes(sdhci_t *sdhci, sdhci_data_t *dat)
 		status = sdhci->reg->rint;
 
 		err = status & SMHC_RINT_INTERRUPT_ERROR_BIT;
-		if (dat->blkcnt > 1)
-			done = status & SMHC_RINT_AUTO_COMMAND_DONE;
-		else
-			done = status & SMHC_RINT_DATA_OVER;
+		done = status & data_done_flag(dat);
 
 	} while (!done && !err);
 
@@ -508,10 +545,7 @@ static bool write_bytes(sdhci_t *sdhci, sdhci_data_t *dat)
 	do {
 		status = sdhci->reg->rint;
 		err	   = status & SMHC_RINT_INTERRUPT_ERROR_BIT;
-		if (dat->blkcnt > 1)
-			done = status & SMHC_RINT_AUTO_COMMAND_DONE;
-		else
-			done = status & SMHC_RINT_DATA_OVER;
+		done = status & data_done_flag(dat);
 	} while (!done && !err);
 
 	if (err & SMHC_RINT_INTERRUPT_ERROR_BIT)
@@ -522,29 +556,9 @@ static bool write_bytes(sdhci_t *sdhci, sdhci_data_t *dat)
 	return TRUE;
 }
 
-bool sdhci_transfer(sdhci_t *sdhci, sdhci_cmd_t *cmd, sdhci_data_t *dat)
+static u32 setup_command(sdhci_t *sdhci, sdhci_cmd_t *cmd, sdhci_data_t *dat)
 {
-	u32	 cmdval = 0;
-	u32	 status = 0;
-	u32	 timeout;
-	bool dma = false;
-
-	trace("SMHC: CMD%" PRIu32 " 0x%" PRIx32 " dlen:%" PRIu32 "\r\n", cmd->idx, cmd->arg,
-		  dat ? dat->blkcnt * dat->blksz : 0);
-
-	if (cmd->idx == MMC_STOP_TRANSMISSION) {
-		timeout = time_ms();
-		do {
-			status = sdhci->reg->status;
-			if (time_ms() - timeout > 10) {
-				sdhci->reg->gctrl = SMHC_GCTRL_HARDWARE_RESET;
-				sdhci->reg->rint  = 0xffffffff;
-				warning("SMHC: stop timeout\r\n");
-				return FALSE;
-			}
-		} while (status & SMHC_STATUS_CARD_DATA_BUSY);
-		return TRUE;
-	}
+	u32 cmdval = 0;
 
 	if (cmd->resptype & MMC_RSP_PRESENT) {
 		cmdval |= SMHC_CMD_RESP_EXPIRE;
@@ -573,83 +587,477 @@ bool sdhci_transfer(sdhci_t *sdhci, sdhci_cmd_t *cmd, sdhci_data_t *dat)
 			sdhci->reg->idst |= SMHC_IDMAC_RECEIVE_INTERRUPT; // clear RX status
 	}
 
-	if (cmd->idx == MMC_WRITE_MULTIPLE_BLOCK || cmd->idx == MMC_READ_MULTIPLE_BLOCK)
+	if ((cmd->idx == MMC_WRITE_MULTIPLE_BLOCK || cmd->idx == MMC_READ_MULTIPLE_BLOCK) &&
+		!(dat && (dat->flag & MMC_DATA_SBC)))
 		cmdval |= SMHC_CMD_SEND_AUTO_STOP;
 
 	sdhci->reg->rint = 0xffffffff; // Clear status
 	sdhci->reg->arg	 = cmd->arg;
 
-	if (dat && (dat->blkcnt * dat->blksz) > 64) {
-		dma = true;
-		sdhci->reg->gctrl &= ~SMHC_GCTRL_ACCESS_BY_AHB;
-		prepare_dma(sdhci, dat);
-		sdhci->reg->cmd = cmdval | cmd->idx | SMHC_CMD_START; // Start
-	} else if (dat && (dat->blkcnt * dat->blksz) > 0) {
-		sdhci->reg->gctrl |= SMHC_GCTRL_ACCESS_BY_AHB;
-		sdhci->reg->cmd = cmdval | cmd->idx | SMHC_CMD_START; // Start
-		if (dat->flag & MMC_DATA_READ && !read_bytes(sdhci, dat))
-			return FALSE;
-		else if (dat->flag & MMC_DATA_WRITE && !write_bytes(sdhci, dat))
+	return cmdval;
+}
+
+static bool wait_card_ready(sdhci_t *sdhci)
+{
+	u32 timeout = time_ms();
+
+	while (sdhci->reg->status & SMHC_STATUS_CARD_DATA_BUSY) {
+		if (time_ms() - timeout > 10) {
+			sdhci->reg->gctrl = SMHC_GCTRL_HARDWARE_RESET;
+			sdhci->reg->rint  = 0xffffffff;
+			warning("SMHC: busy timeout\r\n");
 			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static void read_response(sdhci_t *sdhci, sdhci_cmd_t *cmd)
+{
+	if (cmd->resptype & MMC_RSP_136) {
+		cmd->response[0] = sdhci->reg->resp3;
+		cmd->response[1] = sdhci->reg->resp2;
+		cmd->response[2] = sdhci->reg->resp1;
+		cmd->response[3] = sdhci->reg->resp0;
 	} else {
-		sdhci->reg->gctrl |= SMHC_GCTRL_ACCESS_BY_AHB;
-		sdhci->reg->cmd = cmdval | cmd->idx | SMHC_CMD_START; // Start
+		cmd->response[0] = sdhci->reg->resp0;
+	}
+}
+
+// Cleanup and disable IDMA
+static void stop_dma(sdhci_t *sdhci)
+{
+	u32 status = sdhci->reg->idst;
+
+	sdhci->reg->idst = status;
+	sdhci->reg->idie = 0;
+	sdhci->reg->dmac = 0;
+	sdhci->reg->gctrl &= ~SMHC_GCTRL_DMA_ENABLE;
+}
+
+/*
+ * Start an IDMA data command and return once the card has accepted it.
+ * cmd and dat must stay valid until sdhci_poll() reports completion.
+ */
+bool sdhci_submit(sdhci_t *sdhci, sdhci_cmd_t *cmd, sdhci_data_t *dat)
+{
+	u32 cmdval;
+	u32 status = 0;
+
+	if (sdhci->xfer.dat) {
+		warning("SMHC: cmd%" PRIu32 " submitted while a transfer is in flight\r\n", cmd->idx);
+		return FALSE;
+	}
+	if (!dat || (dat->blkcnt * dat->blksz) <= 64) {
+		error("SMHC: cmd%" PRIu32 " too small for DMA\r\n", cmd->idx);
+		return FALSE;
 	}
 
-	status = 0;
-	if (wait_done(sdhci, 0, 100, SMHC_RINT_COMMAND_DONE, false, &status)) {
+	trace("SMHC: CMD%" PRIu32 " 0x%" PRIx32 " dlen:%" PRIu32 " (async)\r\n", cmd->idx, cmd->arg,
+		  dat->blkcnt * dat->blksz);
+
+	cmdval = setup_command(sdhci, cmd, dat);
+
+	sdhci->reg->gctrl &= ~SMHC_GCTRL_ACCESS_BY_AHB;
+	if (prepare_dma(sdhci, dat) != 0)
+		return FALSE;
+	sdhci->reg->cmd = cmdval | cmd->idx | SMHC_CMD_START; // Start
+
+	if (wait_done(sdhci, 100, SMHC_RINT_COMMAND_DONE, &status)) {
 		warning("SMHC: cmd%" PRIu32 " timeout (rint=0x%08" PRIx32 ", flag=0x%08" PRIx32 ")\r\n",
 			cmd->idx, status, (u32)SMHC_RINT_COMMAND_DONE);
+		stop_dma(sdhci);
 		return FALSE;
 	}
 
-	if (dat && wait_done(sdhci, dat, 6000, dat->blkcnt > 1 ? SMHC_RINT_AUTO_COMMAND_DONE : SMHC_RINT_DATA_OVER, dma, &status)) {
-		u32 complete_flag = dat->blkcnt > 1 ? SMHC_RINT_AUTO_COMMAND_DONE : SMHC_RINT_DATA_OVER;
-		warning("SMHC: data timeout on cmd%" PRIu32 " (rint=0x%08" PRIx32 ", flag=0x%08" PRIx32 ", idst=0x%08" PRIx32 ")\r\n",
-			cmd->idx, status, complete_flag, sdhci->reg->idst);
-		return FALSE;
+	sdhci->xfer.cmd = cmd;
+	sdhci->xfer.dat = dat;
+	sdhci->xfer.start = time_ms();
+	/* Allow at least 1MB/s on top of the fixed budget for multi-megabyte chains */
+	sdhci->xfer.timeout = 6000 + ((dat->blkcnt * dat->blksz) >> 10);
+
+	return TRUE;
+}
+
+/*
+ * Check the transfer started by sdhci_submit() without blocking.
+ * Read buffers are invalidated before SDHCI_XFER_DONE is returned.
+ */
+int sdhci_poll(sdhci_t *sdhci)
+{
+	sdhci_cmd_t	 *cmd = sdhci->xfer.cmd;
+	sdhci_data_t *dat = sdhci->xfer.dat;
+	u32			  status, flag, idma;
+
+	if (!dat)
+		return SDHCI_XFER_DONE;
+
+	status = sdhci->reg->rint;
+	flag   = data_done_flag(dat);
+	idma   = (dat->flag & MMC_DATA_WRITE) ? SMHC_IDMAC_TRANSMIT_INTERRUPT : SMHC_IDMAC_RECEIVE_INTERRUPT;
+
+	if (status & SMHC_RINT_INTERRUPT_ERROR_BIT) {
+		warning("SMHC: data error on cmd%" PRIu32 " (rint=0x%08" PRIx32 ", idst=0x%08" PRIx32 ")\r\n", cmd->idx,
+				status, sdhci->reg->idst);
+		goto fail;
 	}
+	if (!((status & flag) && (sdhci->reg->idst & idma))) {
+		if (time_ms() - sdhci->xfer.start > sdhci->xfer.timeout) {
+			warning("SMHC: data timeout on cmd%" PRIu32 " (rint=0x%08" PRIx32 ", flag=0x%08" PRIx32
+					", idst=0x%08" PRIx32 ")\r\n",
+					cmd->idx, status, flag, sdhci->reg->idst);
+			goto fail;
+		}
+		return SDHCI_XFER_BUSY;
+	}
+
+	if ((cmd->resptype & MMC_RSP_BUSY) && !wait_card_ready(sdhci))
+		goto fail;
+
+	read_response(sdhci, cmd);
+	stop_dma(sdhci);
+
+	/* Drop lines the CPU may have speculatively fetched during the transfer */
+	if (dat->flag & MMC_DATA_READ)
+		invalidate_dcache_range((unsigned long)dat->buf, (unsigned long)dat->buf + dat->blkcnt * dat->blksz);
 
-	if (cmd->resptype & MMC_RSP_BUSY) {
+	sdhci->xfer.cmd = NULL;
+	sdhci->xfer.dat = NULL;
+	return SDHCI_XFER_DONE;
+
+fail:
+	stop_dma(sdhci);
+	sdhci->xfer.cmd = NULL;
+	sdhci->xfer.dat = NULL;
+	return SDHCI_XFER_ERROR;
+}
+
+bool sdhci_wait(sdhci_t *sdhci)
+{
+	int ret;
+
+	do {
+		ret = sdhci_poll(sdhci);
+	} while (ret == SDHCI_XFER_BUSY);
+
+	return ret == SDHCI_XFER_DONE;
+}
+
+bool sdhci_transfer(sdhci_t *sdhci, sdhci_cmd_t *cmd, sdhci_data_t *dat)
+{
+	u32 cmdval;
+	u32 status = 0;
+	u32 timeout;
+
+	if (cmd->idx == MMC_STOP_TRANSMISSION) {
 		timeout = time_ms();
 		do {
 			status = sdhci->reg->status;
 			if (time_ms() - timeout > 10) {
 				sdhci->reg->gctrl = SMHC_GCTRL_HARDWARE_RESET;
 				sdhci->reg->rint  = 0xffffffff;
-				warning("SMHC: busy timeout\r\n");
+				warning("SMHC: stop timeout\r\n");
 				return FALSE;
 			}
 		} while (status & SMHC_STATUS_CARD_DATA_BUSY);
+		return TRUE;
 	}
 
-	if (cmd->resptype & MMC_RSP_136) {
-		cmd->response[0] = sdhci->reg->resp3;
-		cmd->response[1] = sdhci->reg->resp2;
-		cmd->response[2] = sdhci->reg->resp1;
-		cmd->response[3] = sdhci->reg->resp0;
-	} else {
-		cmd->response[0] = sdhci->reg->resp0;
+	if (dat && (dat->blkcnt * dat->blksz) > 64)
+		return sdhci_submit(sdhci, cmd, dat) && sdhci_wait(sdhci);
+
+	trace("SMHC: CMD%" PRIu32 " 0x%" PRIx32 " dlen:%" PRIu32 "\r\n", cmd->idx, cmd->arg,
+		  dat ? dat->blkcnt * dat->blksz : 0);
+
+	cmdval = setup_command(sdhci, cmd, dat);
+
+	sdhci->reg->gctrl |= SMHC_GCTRL_ACCESS_BY_AHB;
+	sdhci->reg->cmd = cmdval | cmd->idx | SMHC_CMD_START; // Start
+	if (dat && (dat->blkcnt * dat->blksz) > 0) {
+		if (dat->flag & MMC_DATA_READ && !read_bytes(sdhci, dat))
+			return FALSE;
+		else if (dat->flag & MMC_DATA_WRITE && !write_bytes(sdhci, dat))
+			return FALSE;
 	}
 
-	// Cleanup and disable IDMA
-	if (dat && dma) {
-		status			 = sdhci->reg->idst;
-		sdhci->reg->idst = status;
-		sdhci->reg->idie = 0;
-		sdhci->reg->dmac = 0;
-		sdhci->reg->gctrl &= ~SMHC_GCTRL_DMA_ENABLE;
+	if (wait_done(sdhci, 100, SMHC_RINT_COMMAND_DONE, &status)) {
+		warning("SMHC: cmd%" PRIu32 " timeout (rint=0x%08" PRIx32 ", flag=0x%08" PRIx32 ")\r\n",
+			cmd->idx, status, (u32)SMHC_RINT_COMMAND_DONE);
+		return FALSE;
 	}
 
+	if (dat && wait_done(sdhci, 6000, data_done_flag(dat), &status)) {
+		warning("SMHC: data timeout on cmd%" PRIu32 " (rint=0x%08" PRIx32 ", flag=0x%08" PRIx32 ")\r\n",
+			cmd->idx, status, data_done_flag(dat));
+		return FALSE;
+	}
+
+	if ((cmd->resptype & MMC_RSP_BUSY) && !wait_card_ready(sdhci))
+		return FALSE;
+
+	read_response(sdhci, cmd);
 	return TRUE;
 }
 
+u32 sdhci_max_blkcnt(sdhci_t *sdhci, u32 blksz)
+{
+	return (sdhci->dma_desc_num * SMHC_DES_BUFFER_MAX_LEN) / blksz;
+}
+
 bool sdhci_reset(sdhci_t *sdhci)
 {
 	sdhci->reg->gctrl = SMHC_GCTRL_HARDWARE_RESET;
 	return TRUE;
 }
 
+__weak bool board_sdhci_set_voltage(sdhci_t *sdhci, u32 voltage)
+{
+	return voltage == sdhci->voltage;
+}
+
+bool sdhci_set_voltage(sdhci_t *sdhci, u32 voltage)
+{
+	if (!board_sdhci_set_voltage(sdhci, voltage))
+		return FALSE;
+	sdhci->voltage = voltage;
+	return TRUE;
+}
+
+/*
+ * UHS-I signal voltage switch: send CMD11, stop the card clock, move the IO
+ * rail to 1.8V, restart the clock and wait for the card to release DAT.
+ */
+bool sdhci_voltage_switch(sdhci_t *sdhci, sdhci_cmd_t *cmd)
+{
+	u32 cmdval;
+	u32 status = 0;
+	u32 start;
+
+	cmdval = setup_command(sdhci, cmd, NULL);
+	sdhci->reg->gctrl |= SMHC_GCTRL_ACCESS_BY_AHB;
+	sdhci->reg->cmd = cmdval | SMHC_CMD_VOLTAGE_SWITCH | cmd->idx | SMHC_CMD_START;
+
+	if (wait_done(sdhci, 100, SMHC_RINT_COMMAND_DONE, &status)) {
+		warning("SMHC: cmd%" PRIu32 " timeout (rint=0x%08" PRIx32 ")\r\n", cmd->idx, status);
+		return FALSE;
+	}
+	read_response(sdhci, cmd);
+
+	sdhci->reg->clkcr |= SMHC_CLKCR_MASK_D0;
+	sdhci->reg->clkcr &= ~SMHC_CLKCR_CARD_CLOCK_ON;
+	if (!update_card_clock(sdhci))
+		return FALSE;
+
+	if (!sdhci_set_voltage(sdhci, MMC_VDD_165_195)) {
+		warning("SMHC: board cannot switch %s to 1.8V\r\n", sdhci->name);
+		return FALSE;
+	}
+	mdelay(5);
+
+	sdhci->reg->clkcr |= SMHC_CLKCR_CARD_CLOCK_ON;
+	if (!update_card_clock(sdhci))
+		return FALSE;
+	sdhci->reg->clkcr &= ~SMHC_CLKCR_MASK_D0;
+
+	start = time_ms();
+	while (!(sdhci->reg->rint & SMHC_RINT_VOLTAGE_CHANGE_DONE)) {
+		if (time_ms() - start > 10) {
+			warning("SMHC: voltage switch timeout (rint=0x%08" PRIx32 ")\r\n", sdhci->reg->rint);
+			return FALSE;
+		}
+	}
+	sdhci->reg->rint = 0xffffffff;
+
+	return TRUE;
+}
+
+/* Read one short block by PIO; failures are expected while sweeping and stay quiet */
+bool sdhci_probe_read(sdhci_t *sdhci, u32 opcode, u32 arg, u32 *buf, u32 len)
+{
+	sdhci_cmd_t	 cmd = {0};
+	sdhci_data_t dat = {0};
+	u32			 cmdval, status;
+	u32			 count = 0;
+	u32			 start = time_ms();
+
+	cmd.idx		 = opcode;
+	cmd.arg		 = arg;
+	cmd.resptype = MMC_RSP_R1;
+	dat.buf		 = (u8 *)buf;
+	dat.flag	 = MMC_DATA_READ;
+	dat.blksz	 = len;
+	dat.blkcnt	 = 1;
+
+	cmdval = setup_command(sdhci, &cmd, &dat);
+	sdhci->reg->gctrl |= SMHC_GCTRL_ACCESS_BY_AHB;
+	sdhci->reg->cmd = cmdval | cmd.idx | SMHC_CMD_START;
+
+	do {
+		status = sdhci->reg->rint;
+		if ((status & SMHC_RINT_INTERRUPT_ERROR_BIT) || (time_ms() - start > 10))
+			goto fail;
+		while (count < len / 4 && !(sdhci->reg->status & SMHC_STATUS_FIFO_EMPTY))
+			buf[count++] = sdhci->reg->fifo;
+	} while (count < len / 4 || !(status & SMHC_RINT_DATA_OVER));
+
+	return TRUE;
+
+fail:
+	sdhci->reg->gctrl |= SMHC_GCTRL_FIFO_RESET;
+	while ((sdhci->reg->status & SMHC_STATUS_DATA_FSM_BUSY) && (time_ms() - start < 20)) {
+	}
+	sdhci->reg->rint = 0xffffffff;
+	return FALSE;
+}
+
+/*
+ * Sweep the software sample delay over its whole range with CMD19 (SD) or
+ * CMD21 (eMMC) and settle in the middle of the widest passing window.
+ * CMD21 on an 8-bit bus returns the 128-byte pattern.
+ */
+bool sdhci_execute_tuning(sdhci_t *sdhci, u32 opcode)
+{
+	const u8 *pattern = tuning_blk_pattern_4bit;
+	u32		  len	  = sizeof(tuning_blk_pattern_4bit);
+	u32		  buf[sizeof(tuning_blk_pattern_8bit) / 4];
+	u32		  dly, run = 0, best = 0, best_end = 0, passed = 0;
+
+	if (opcode == MMC_SEND_TUNING_BLOCK_HS200 && sdhci->width == MMC_BUS_WIDTH_8) {
+		pattern = tuning_blk_pattern_8bit;
+		len		= sizeof(tuning_blk_pattern_8bit);
+	}
+
+	/* A delay remembered from an earlier boot only has to pass twice to be kept */
+	if (sdhci->tune_hint >= 0) {
+		dly					= sdhci->tune_hint;
+		sdhci->tune_hint	= -1;
+		sdhci->reg->samp_dl = SDXC_CAL_DL_SW_EN | (dly << SDXC_CAL_DL_SW_SHIFT);
+		for (run = 0; run < 2; run++) {
+			if (!sdhci_probe_read(sdhci, opcode, 0, buf, len) || memcmp(buf, pattern, len))
+				break;
+		}
+		if (run == 2) {
+			sdhci->tuned	 = TRUE;
+			sdhci->tuned_dly = dly;
+			debug("SMHC: reused sample delay %" PRIu32 "\r\n", dly);
+			return TRUE;
+		}
+		run = 0;
+	}
+
+	for (dly = 0; dly <= SDXC_CAL_DL_MASK; dly++) {
+		sdhci->reg->samp_dl = SDXC_CAL_DL_SW_EN | (dly << SDXC_CAL_DL_SW_SHIFT);
+		if (sdhci_probe_read(sdhci, opcode, 0, buf, len) && !memcmp(buf, pattern, len)) {
+			passed++;
+			if (++run > best) {
+				best	 = run;
+				best_end = dly;
+			}
+		} else {
+			run = 0;
+		}
+	}
+
+	if (!best) {
+		warning("SMHC: tuning with cmd%" PRIu32 " found no working sample delay\r\n", opcode);
+		return FALSE;
+	}
+
+	dly					= best_end + 1 - best + (best - 1) / 2;
+	sdhci->reg->samp_dl = SDXC_CAL_DL_SW_EN | (dly << SDXC_CAL_DL_SW_SHIFT);
+	sdhci->tuned		= TRUE;
+	sdhci->tuned_dly	= dly;
+	debug("SMHC: tuned sample delay %" PRIu32 " (window %" PRIu32 "-%" PRIu32 ", %" PRIu32 "/64 passed)\r\n", dly,
+		  best_end + 1 - best, best_end, passed);
+	return TRUE;
+}
+
+/* Read a block by PIO and compare it with a known copy */
+bool sdhci_verify_read(sdhci_t *sdhci, u32 opcode, u32 arg, const u32 *ref, u32 len)
+{
+	static u32 buf[SDHCI_PHASE_MAX_PROBE / 4];
+
+	if (len > sizeof(buf))
+		return FALSE;
+	return sdhci_probe_read(sdhci, opcode, arg, buf, len) && !memcmp(buf, ref, len);
+}
+
+/*
+ * Sweep the output (2) and sample (4) phases of the active clock reading a
+ * known block, and keep the centre of the widest passing sample window. The
+ * fine sample delay is left to the hardware calibration in config_delay().
+ */
+bool sdhci_calibrate_phase(sdhci_t *sdhci, u32 opcode, u32 arg, const u32 *ref, u32 len)
+{
+	smhc_clk_t clk	 = sdhci->clock_active;
+	u8		   odly	 = sdhci->odly[clk];
+	u8		   sdly	 = sdhci->sdly[clk];
+	u8		   pass[2] = {0};
+	u32		   o, s, start, run, best = 0;
+
+	for (o = 0; o < 2; o++) {
+		for (s = 0; s < 4; s++) {
+			sdhci->odly[clk] = o;
+			sdhci->sdly[clk] = s;
+			if (config_delay(sdhci) == 0 && sdhci_verify_read(sdhci, opcode, arg, ref, len))
+				pass[o] |= 1 << s;
+			else
+				udelay(100); /* let the card finish a block we failed to take */
+		}
+	}
+
+	for (o = 0; o < 2; o++) {
+		/* The sample phases wrap around: 90, 180, 270, 0 */
+		for (start = 0; start < 4; start++) {
+			if (!(pass[o] & (1 << start)) || (pass[o] != 0xf && (pass[o] & (1 << ((start + 3) & 3)))))
+				continue;
+			for (run = 0; run < 4 && (pass[o] & (1 << ((start + run) & 3))); run++) {
+			}
+			if (run > best || (run == best && o == odly)) {
+				best			 = run;
+				sdhci->odly[clk] = o;
+				sdhci->sdly[clk] = (run == 4) ? sdly : ((start + (run - 1) / 2) & 3);
+			}
+		}
+	}
+
+	if (!best) {
+		sdhci->odly[clk] = odly;
+		sdhci->sdly[clk] = sdly;
+		config_delay(sdhci);
+		warning("SMHC: no working phase found at clock %u\r\n", clk);
+		return FALSE;
+	}
+
+	debug("SMHC: phase calibration odly %u sdly %u (pass 0x%x/0x%x)\r\n", sdhci->odly[clk], sdhci->sdly[clk], pass[0],
+		  pass[1]);
+	return config_delay(sdhci) == 0;
+}
+
+u32 sdhci_get_phase(sdhci_t *sdhci)
+{
+	smhc_clk_t clk	 = sdhci->clock_active;
+	u32		   phase = SDHCI_PHASE_VALID | (clk << 12) | ((sdhci->odly[clk] & 0x1) << 11) | ((sdhci->sdly[clk] & 0x3) << 9);
+
+	if (sdhci->tuned)
+		phase |= SDHCI_PHASE_TUNED | sdhci->tuned_dly;
+	return phase;
+}
+
+/* Seed the timing of a clock before sdhci_set_clock() selects it */
+void sdhci_set_phase(sdhci_t *sdhci, u32 phase)
+{
+	u32 clk = SDHCI_PHASE_CLOCK(phase);
+
+	if (!(phase & SDHCI_PHASE_VALID) || clk >= SMHC_CLK_COUNT)
+		return;
+
+	sdhci->odly[clk] = SDHCI_PHASE_ODLY(phase);
+	sdhci->sdly[clk] = SDHCI_PHASE_SDLY(phase);
+	if (phase & SDHCI_PHASE_TUNED)
+		sdhci->tune_hint = SDHCI_PHASE_SAMP(phase);
+}
+
 bool sdhci_set_width(sdhci_t *sdhci, u32 width)
 {
 	const char UNUSED_TRACE *mode = "1 bit";
@@ -668,6 +1076,15 @@ bool sdhci_set_width(sdhci_t *sdhci, u32 width)
 			if (enable_ddr)
 				mode = "4 bit DDR";
 			break;
+		case MMC_BUS_WIDTH_8:
+			sdhci->reg->width = SMHC_WIDTH_8BIT;
+			mode			  = "8 bit";
+			enable_ddr		  = (sdhci->clock_active == MMC_CLK_50M_DDR) || sdhci->hs400;
+			if (sdhci->hs400)
+				mode = "8 bit HS400";
+			else if (enable_ddr)
+				mode = "8 bit DDR";
+			break;
 		default:
 			error("SMHC: %" PRIu32 " width value invalid\r\n", width);
 			return FALSE;
@@ -681,7 +1098,7 @@ bool sdhci_set_width(sdhci_t *sdhci, u32 width)
 	sdhci->reg->gctrl = gctrl;
 
 	/* Re-apply start bit detection settings after clock gating resets the block. */
-	sdhci_configure_start_bit_detection(sdhci, false);
+	sdhci_configure_start_bit_detection(sdhci, sdhci->hs400);
 
 	/* Re-run delay calibration once DDR is active so the sampling window matches */
 	if (enable_ddr) {
@@ -689,6 +1106,12 @@ bool sdhci_set_width(sdhci_t *sdhci, u32 width)
 			warning("SMHC: DDR delay calibration failed\r\n");
 	}
 
+	/* HS400 latches read data on the card's data strobe */
+	if (sdhci->hs400 && calibrate_delay(&sdhci->reg->ds_dl, "data strobe") < 0) {
+		error("SMHC: HS400 data strobe calibration failed\r\n");
+		return FALSE;
+	}
+
 	debug("SMHC: set width to %s (gctrl=0x%08" PRIx32 ", clk_active=%u)\r\n", mode, sdhci->reg->gctrl, sdhci->clock_active);
 	return TRUE;
 }
@@ -711,12 +1134,52 @@ static int init_default_timing(sdhci_t *sdhci)
 	sdhci->sdly[MMC_CLK_150M]	 = TM5_IN_PH90;
 	sdhci->sdly[MMC_CLK_200M]	 = TM5_IN_PH90;
 
+	sdhci->tuned	 = FALSE;
+	sdhci->tune_hint = -1;
+
+	return 0;
+}
+
+/*
+ * Run the hardware calibration of a delay chain (sample or data strobe) and
+ * lock the measured value in as the software delay.
+ */
+static int calibrate_delay(volatile u32 *reg, const char UNUSED_DEBUG *name)
+{
+	u32 calib, timeout, delay;
+
+	calib = *reg;
+	calib &= ~SDXC_CAL_DL_SW_EN;
+	calib &= ~((SDXC_CAL_DL_MASK << SDXC_CAL_DL_SW_SHIFT) | SDXC_CAL_START | SDXC_CAL_DONE);
+	*reg = calib | SDXC_CAL_START;
+
+	timeout = time_us();
+	do {
+		calib = *reg;
+		if (time_us() - timeout > SDXC_CAL_TIMEOUT_MS * 1000) {
+			warning("SMHC: %s delay calibration timeout\r\n", name);
+			*reg = SDXC_CAL_DL_SW_EN;
+			return -1;
+		}
+	} while (!(calib & SDXC_CAL_DONE));
+
+	delay = (calib >> SDXC_CAL_DL_SHIFT) & SDXC_CAL_DL_MASK;
+	if (!delay)
+		delay = 1; /* avoid a zero delay which behaves poorly under DDR */
+
+	calib &= ~SDXC_CAL_START;
+	calib &= ~(SDXC_CAL_DL_MASK << SDXC_CAL_DL_SW_SHIFT);
+	calib &= ~SDXC_CAL_DL_SW_EN;
+	calib |= (delay << SDXC_CAL_DL_SW_SHIFT) | SDXC_CAL_DL_SW_EN;
+	*reg = calib;
+
+	debug("SMHC: %s calibration complete (raw=0x%08" PRIx32 ", delay=%" PRIu32 ") in %" PRIu32 " us\r\n", name, calib,
+		  delay, (u32)(time_us() - timeout));
 	return 0;
 }
 
 static int config_delay(sdhci_t *sdhci)
 {
-	u32	      calib, timeout, delay;
 	u32			  rval, freq;
 	u8			  odly, sdly;
 	volatile u32 *clk_cfg;
@@ -755,32 +1218,9 @@ static int config_delay(sdhci_t *sdhci)
   /* Don't run calibration for 400KHz */
   if (freq > MMC_CLK_400K) {
     /* re-run sample delay calibration to stabilise DDR sampling */
-    calib = sdhci->reg->samp_dl;
-    calib &= ~SDXC_CAL_DL_SW_EN;
-    calib &= ~((SDXC_CAL_DL_MASK << SDXC_CAL_DL_SW_SHIFT) | SDXC_CAL_START | SDXC_CAL_DONE);
-    sdhci->reg->samp_dl = calib | SDXC_CAL_START;
-
-    timeout = time_us();
-    do {
-      calib = sdhci->reg->samp_dl;
-      if (time_us() - timeout > SDXC_CAL_TIMEOUT_MS * 1000) {
-        warning("SMHC: sample delay calibration timeout\r\n");
-        sdhci->reg->samp_dl = SDXC_CAL_DL_SW_EN;
-        return -1;
-      }
-    } while (!(calib & SDXC_CAL_DONE));
-
-    delay = (calib >> SDXC_CAL_DL_SHIFT) & SDXC_CAL_DL_MASK;
-    if (!delay)
-      delay = 1; /* avoid a zero delay which behaves poorly under DDR */
-
-    calib &= ~SDXC_CAL_START;
-    calib &= ~(SDXC_CAL_DL_MASK << SDXC_CAL_DL_SW_SHIFT);
-    calib &= ~SDXC_CAL_DL_SW_EN;
-    calib |= (delay << SDXC_CAL_DL_SW_SHIFT) | SDXC_CAL_DL_SW_EN;
-    sdhci->reg->samp_dl = calib;
-
-    debug("SMHC: calibration complete (raw=0x%08" PRIx32 ", delay=%" PRIu32 ") in %" PRIu32 " us\r\n", calib, delay, (u32)(time_us() - timeout));
+    sdhci->tuned = FALSE;
+    if (calibrate_delay(&sdhci->reg->samp_dl, "sample") < 0)
+      return -1;
   }
 
 	return 0;
@@ -814,7 +1254,7 @@ bool sdhci_set_clock(sdhci_t *sdhci, smhc_clk_t clock)
 	}
 
 	sdhci->clock_active = clock;
-	is_ddr		 = (clock == MMC_CLK_50M_DDR);
+	is_ddr		 = (clock == MMC_CLK_50M_DDR) || sdhci->hs400;
 
 	switch (clock) {
 		case MMC_CLK_400K:
@@ -841,6 +1281,7 @@ bool sdhci_set_clock(sdhci_t *sdhci, smhc_clk_t clock)
 			return false;
 	}
 
+	sdhci->bus_hz = hz;
 	if (hz < 1000000) {
 		debug("SMHC: set clock to %luKHz\r\n", (hz / 1000));
 	} else {
@@ -957,8 +1398,27 @@ int sunxi_sdhci_init(sdhci_t *sdhci)
 	sunxi_gpio_init(sdhci->gpio_d3.pin, sdhci->gpio_d3.mux);
 	sunxi_gpio_set_pull(sdhci->gpio_d3.pin, GPIO_PULL_UP);
 
+	if (sdhci->width == MMC_BUS_WIDTH_8) {
+		sunxi_gpio_init(sdhci->gpio_d4.pin, sdhci->gpio_d4.mux);
+		sunxi_gpio_set_pull(sdhci->gpio_d4.pin, GPIO_PULL_UP);
+
+		sunxi_gpio_init(sdhci->gpio_d5.pin, sdhci->gpio_d5.mux);
+		sunxi_gpio_set_pull(sdhci->gpio_d5.pin, GPIO_PULL_UP);
+
+		sunxi_gpio_init(sdhci->gpio_d6.pin, sdhci->gpio_d6.mux);
+		sunxi_gpio_set_pull(sdhci->gpio_d6.pin, GPIO_PULL_UP);
+
+		sunxi_gpio_init(sdhci->gpio_d7.pin, sdhci->gpio_d7.mux);
+		sunxi_gpio_set_pull(sdhci->gpio_d7.pin, GPIO_PULL_UP);
+	}
+
 	init_default_timing(sdhci);
 
+	/* Each controller owns a slice of the DRAM descriptor pool */
+	sdhci->dma_desc_num = CONFIG_SMHC_DMA_DESC_NUM;
+	sdhci->dma_desc		= (sdhci_idma_desc_t *)(CONFIG_SMHC_DMA_DESC_ADDR +
+											sdhci->id * CONFIG_SMHC_DMA_DESC_NUM * sizeof(sdhci_idma_desc_t));
+
 	sdhci->reg->gctrl = SMHC_GCTRL_HARDWARE_RESET;
 	sdhci->reg->rint  = 0xffffffff;
 
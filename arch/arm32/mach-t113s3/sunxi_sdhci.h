@@ -15,6 +15,17 @@ typedef enum {
 
 #define SMHC_CLK_COUNT 7
 
+/* Optional bus modes, set per controller by the board */
+enum {
+	SMHC_CAP_UHS_SDR50	= (1 << 0), /* SD UHS-I up to 100MHz, needs a 1.8V IO rail */
+	SMHC_CAP_UHS_SDR104 = (1 << 1), /* SD UHS-I up to 208MHz, needs a 1.8V IO rail */
+	SMHC_CAP_MMC_HS200	= (1 << 2), /* eMMC HS200, needs 1.8V VCCQ */
+	SMHC_CAP_MMC_HS400	= (1 << 3), /* eMMC HS400, needs 1.8V VCCQ and an 8-bit bus */
+	SMHC_CAP_MMC_HS400_ES = (1 << 4), /* HS400 with enhanced strobe, skips tuning */
+};
+
+#define SMHC_CAP_UHS (SMHC_CAP_UHS_SDR50 | SMHC_CAP_UHS_SDR104)
+
 typedef struct {
 	volatile u32 gctrl; /* (0x00) SMC Global Control Register */
 	volatile u32 clkcr; /* (0x04) SMC Clock Control Register */
@@ -109,6 +120,32 @@ typedef struct {
 
 } sdhci_idma_desc_t __attribute__((aligned(8)));
 
+/*
+ * Timing of one clock packed into 16 bits by sdhci_get_phase(), small enough
+ * to keep in an RTC backup register next to a card key.
+ */
+#define SDHCI_PHASE_VALID		(1 << 15)
+#define SDHCI_PHASE_CLOCK(p)	(((p) >> 12) & 0x7)
+#define SDHCI_PHASE_ODLY(p)		(((p) >> 11) & 0x1)
+#define SDHCI_PHASE_SDLY(p)		(((p) >> 9) & 0x3)
+#define SDHCI_PHASE_TUNED		(1 << 8)
+#define SDHCI_PHASE_SAMP(p)		((p)&0x3f)
+#define SDHCI_PHASE_MAX_PROBE	512 /* bytes, largest pattern sdhci_calibrate_phase() compares */
+
+/* sdhci_poll() results */
+enum {
+	SDHCI_XFER_ERROR = -1,
+	SDHCI_XFER_BUSY	 = 0,
+	SDHCI_XFER_DONE	 = 1,
+};
+
+typedef struct {
+	sdhci_cmd_t	 *cmd;
+	sdhci_data_t *dat; /* NULL when no transfer is in flight */
+	u32			  start;
+	u32			  timeout;
+} sdhci_xfer_t;
+
 typedef struct {
 	char		*name;
 	sdhci_reg_t *reg;
@@ -117,14 +154,22 @@ typedef struct {
 
 	u32		   voltage;
 	u32		   width;
+	u32		   caps;
 	smhc_clk_t clock_active;
 	smhc_clk_t clock_wanted;
+	u32		   bus_hz; /* card clock, for reporting */
+	bool	   hs400; /* DDR on the data strobe, set before sdhci_set_clock() */
 	u32		   pclk;
 	u8		   odly[SMHC_CLK_COUNT];
 	u8		   sdly[SMHC_CLK_COUNT];
+	bool	   tuned; /* samp_dl holds a tuned delay, cleared by the hardware calibration */
+	u8		   tuned_dly;
+	s8		   tune_hint; /* sample delay tried before a full tuning sweep, -1 if none */
 
-	sdhci_idma_desc_t dma_desc[32];
-	u32				  dma_trglvl;
+	sdhci_idma_desc_t *dma_desc; /* descriptor pool, CONFIG_SMHC_DMA_DESC_NUM entries in DRAM */
+	u32				   dma_desc_num;
+	u32				   dma_trglvl;
+	sdhci_xfer_t	   xfer;
 
 	bool removable;
 	bool isspi;
@@ -133,6 +178,10 @@ typedef struct {
 	gpio_mux_t gpio_d1;
 	gpio_mux_t gpio_d2;
 	gpio_mux_t gpio_d3;
+	gpio_mux_t gpio_d4; /* d4-d7 only used with MMC_BUS_WIDTH_8 */
+	gpio_mux_t gpio_d5;
+	gpio_mux_t gpio_d6;
+	gpio_mux_t gpio_d7;
 	gpio_mux_t gpio_cmd;
 	gpio_mux_t gpio_clk;
 
@@ -143,6 +192,20 @@ bool sdhci_set_voltage(sdhci_t *hci, u32 voltage);
 bool sdhci_set_width(sdhci_t *hci, u32 width);
 bool sdhci_set_clock(sdhci_t *hci, smhc_clk_t hz);
 bool sdhci_transfer(sdhci_t *hci, sdhci_cmd_t *cmd, sdhci_data_t *dat);
+bool sdhci_submit(sdhci_t *hci, sdhci_cmd_t *cmd, sdhci_data_t *dat);
+int	 sdhci_poll(sdhci_t *hci);
+bool sdhci_wait(sdhci_t *hci);
+u32	 sdhci_max_blkcnt(sdhci_t *hci, u32 blksz);
+bool sdhci_voltage_switch(sdhci_t *hci, sdhci_cmd_t *cmd);
+bool sdhci_execute_tuning(sdhci_t *hci, u32 opcode);
+bool sdhci_probe_read(sdhci_t *hci, u32 opcode, u32 arg, u32 *buf, u32 len);
+bool sdhci_verify_read(sdhci_t *hci, u32 opcode, u32 arg, const u32 *ref, u32 len);
+bool sdhci_calibrate_phase(sdhci_t *hci, u32 opcode, u32 arg, const u32 *ref, u32 len);
+u32	 sdhci_get_phase(sdhci_t *hci);
+void sdhci_set_phase(sdhci_t *hci, u32 phase);
 int	 sunxi_sdhci_init(sdhci_t *sdhci);
 
+/* Board hook: switch the controller's IO rail, the default reports no support */
+bool board_sdhci_set_voltage(sdhci_t *hci, u32 voltage);
+
 #endif /* __SDHCI_H__ */
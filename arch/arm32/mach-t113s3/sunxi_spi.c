@@ -30,6 +30,7 @@
 #include "sunxi_clk.h"
 #include "sunxi_dma.h"
 #include "debug.h"
+#include <asm/cache.h>
 
 enum {
 	SPI_GCR = 0x04,
@@ -572,12 +573,14 @@ static int spi_transfer(sunxi_spi_t *spi, spi_io_mode_t mode, void *txbuf, uint3
 	if (rxbuf && rxlen) {
 		if (rxlen > 64) {
 			write32(spi->base + SPI_FCR, (fcr | SPI_FCR_RX_DRQEN_MSK)); // Enable RX FIFO DMA request
+			flush_dcache_range((unsigned long)rxbuf, (unsigned long)rxbuf + rxlen);
 			if (dma_start(spi_rx_dma_hd, spi->base + SPI_RXD, (u32)rxbuf, rxlen) != 0) {
 				error("SPI: DMA transfer failed\r\n");
 				return -1;
 			}
 			while (dma_querystatus(spi_rx_dma_hd)) {
 			};
+			invalidate_dcache_range((unsigned long)rxbuf, (unsigned long)rxbuf + rxlen);
 		} else {
 			spi_read_rx_fifo(spi, rxbuf, rxlen);
 		}
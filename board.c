@@ -55,6 +55,7 @@ sdhci_t sdhci0 = {
 };
 
 // eMMC on SMHC2
+// The T113-S3 package only brings out D0-D3 for SMHC2, so HS400 (8-bit only) is not available here
 sdhci_t sdhci2 = {
 	.name		      = "sdhci2",
 	.reg		      = (sdhci_reg_t *)0x04022000,
@@ -77,11 +78,11 @@ static gpio_t led_blue = GPIO_PIN(PORTD, 22);
 
 static void board_reset_mmc(void)
 {
-	/* Assert reset, wait, then deassert to guarantee a clean start */
+	/* Assert reset for tRSTW (1us), then give the card tRSCA (200us) before the first command */
 	sunxi_gpio_write(mmc_rst, 1);
-	mdelay(1);
+	udelay(1);
 	sunxi_gpio_write(mmc_rst, 0);
-	mdelay(10);
+	udelay(200);
 }
 
 static void output_init(const gpio_t gpio)
@@ -113,6 +114,16 @@ void board_set_led(uint8_t num, uint8_t on)
 	}
 }
 
+#if (CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC) && CONFIG_SDMMC_EARLY_START
+void board_dram_idle(void)
+{
+	sdmmc_early_poll(&card0);
+#if CONFIG_SDMMC_CARD1
+	sdmmc_early_poll(&card1);
+#endif
+}
+#endif
+
 void board_init()
 {
 	board_init_led(led_blue);
@@ -15,7 +15,12 @@
 #define CONFIG_MMC_ENABLE_RSTN 0
 #endif
 
-#define RTC_BKP_REG(n) *((uint32_t *)((0x07090100) + (n * 4)))
+#define CONFIG_SDMMC_EARLY_START 1 // start card power-up before DRAM init, polled between the DRAM steps
+#define CONFIG_MMC_CMDQ			 1 // queue image reads as CMDQ tasks on eMMC 5.1 parts with a command queue
+
+#define RTC_BKP_REG(n) *((volatile uint32_t *)((0x07090100) + ((n) * 4)))
+#define CONFIG_SDMMC_CACHE_BKP_REG 1 // RTC_BKP_REG(1..3): card identity and bus mode for warm reboots
+#define CONFIG_SDMMC_PHASE_BKP_REG 5 // RTC_BKP_REG(5 + SMHC id): phase calibration kept across warm boots
 
 #define MB(x) ((uint32_t)(x) * 1024U * 1024U)
 #define CONFIG_INITRAMFS_MAX_SIZE   MB(25)
@@ -23,6 +28,12 @@
 #define CONFIG_KERNEL_LOAD_ADDR	    (SDRAM_BASE + MB(32))
 #define CONFIG_DTB_GUARD_SIZE	      MB(1)
 
+// DRAM scratch used while loading, kept below the kernel load address
+#define CONFIG_MMU_TTB_ADDR (SDRAM_BASE + MB(31)) // 16KB section table, 16KB aligned
+#define CONFIG_SMHC_DMA_DESC_ADDR (SDRAM_BASE + MB(30)) // IDMA descriptor pools, one slice per controller
+#define CONFIG_SMHC_DMA_DESC_NUM  2048 // descriptors per controller, 4KB each: 8MB per command
+#define CONFIG_BLOCK_TRACE_BUF	  (SDRAM_BASE + MB(29)) // sectors prefetched from the block trace, 1MB
+
 #define CONFIG_INITRD_ALIGNMENT	  64U
 
 // FEL mailbox layout (must match host FEL script)
@@ -41,8 +52,33 @@
 #define CONFIG_BOOT_SDCARD	0
 #define CONFIG_BOOT_MMC		1
 
-#define CONFIG_FATFS_CACHE_SIZE		 36 // (unit: 512B sectors, multiples of 8 to match FAT's 4KB)
-#define CONFIG_SDMMC_SPEED_TEST_SIZE 2048 // (unit: 512B sectors)
+#define CONFIG_MMC_BOOT_PART 1 // try images from eMMC boot0/boot1 (tools/mkbootpart) before FAT
+
+// Load raw images from GPT partitions found by name instead of FAT files (FAT stays the fallback)
+#define CONFIG_SDMMC_GPT_BOOT	0
+#define CONFIG_GPT_DTB_NAME		"dtb_a"
+#define CONFIG_GPT_KERNEL_NAME	"kernel_a"
+#define CONFIG_GPT_INITRD_NAME	"initrd_a" // "" to boot without an initrd
+
+// Load FAT files by LBA from the index that tools/mkbootidx writes into the volume, without mounting it
+// (FatFs stays the fallback when there is no index or a file changed)
+#define CONFIG_FAT_BOOT_INDEX 1
+
+// Also bring up SDHCI_CARD1 as card1: FAT paths starting with "1:" and GPT partitions not found on
+// card0 are read from it, concurrently with card0. sdhci2 shares its pins with SPI NAND.
+#define CONFIG_SDMMC_CARD1 0
+
+#define CONFIG_FATFS_CACHE_SIZE 64 // (unit: 512B sectors) LRU of 4KB blocks, multiples of 8
+
+// Record the sectors FatFs reads on a good boot and prefetch them in one batch on the next one. The trace is
+// written to CONFIG_BLOCK_TRACE_LBA of the boot card, which must be unused (it is only written when it lies between
+// the MBR/GPT and the first partition and is zero or already holds a trace).
+#define CONFIG_BLOCK_TRACE	   0
+#define CONFIG_BLOCK_TRACE_LBA 2047 // last sector before a first partition at 1MB
+
+// Benchmark every card and the SPI-NAND before loading and print "BENCH," records, see lib/bench.c
+#define CONFIG_STORAGE_BENCH	  0
+#define CONFIG_STORAGE_BENCH_SPAN (4 * 1024 * 1024) // bytes read per transfer size and pattern
 
 #define CONFIG_CPU_FREQ 1200000000
 
@@ -69,5 +105,6 @@ void board_set_led(uint8_t num, uint8_t on);
 
 #define USART_DBG usart0_dbg
 #define SDHCI sdhci0
+#define SDHCI_CARD1 sdhci2
 
 #endif
@@ -0,0 +1,232 @@
+#include "common.h"
+#include "board.h"
+#include "bench.h"
+
+#if CONFIG_STORAGE_BENCH
+
+#include "sunxi_wdg.h"
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+#include "sdmmc.h"
+#endif
+#if CONFIG_BOOT_SPINAND
+#include "sunxi_dma.h"
+#endif
+
+/*
+ * Report on the UART, one record per line, fields separated by commas:
+ *   BENCH,begin,<revision>
+ *   BENCH,dev,<device>,<type>,<timing>,<bus Hz>,<size KB>
+ *   BENCH,result,<device>,<path>,<seq|rand>,<bytes per read>,<reads>,<total us>,<KB/s>,
+ *         <min us>,<p50 us>,<p90 us>,<p99 us>,<max us>
+ *   BENCH,stats,<device>,<reads>,<CMD23 reads>,<commands>,<status skipped>,<stop skipped>
+ *   BENCH,error,<device>,<path>,<seq|rand>,<bytes per read>,<block>
+ *   BENCH,end,<total ms>
+ * Latencies are per read call, one command up to the SMHC descriptor limit.
+ */
+
+#define BENCH_BLOCK		 512
+#define BENCH_MAX_LEN	 (8U * 1024U * 1024U)
+#define BENCH_SAMPLES	 256
+#define BENCH_MIN_COUNT	 2
+#define BENCH_BUF		 ((u8 *)SDRAM_BASE)
+#define BENCH_WDG		 16 // s, one 8MB SPI-NAND read takes a while
+#define BENCH_RAND_SEED	 0x2545f491 // fixed, so that runs are comparable
+
+typedef struct {
+	const char *name;
+	const char *path; /* "idma", "pio" or "spi" */
+	uint32_t	blocks; /* size in 512B blocks */
+	uint32_t	min_len; /* smallest read, offsets are aligned to it as well */
+	uint32_t	max_len;
+	bool (*read)(void *ctx, u8 *buf, uint32_t blkno, uint32_t len);
+	void *ctx;
+} bench_dev_t;
+
+static uint32_t bench_lat[BENCH_SAMPLES];
+static uint32_t bench_seed;
+
+static uint32_t bench_rand(void)
+{
+	// xorshift32
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+static void bench_sort(uint32_t *v, uint32_t n)
+{
+	uint32_t i, j, x;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+static uint32_t bench_pct(uint32_t n, uint32_t pct)
+{
+	return bench_lat[(n - 1) * pct / 100];
+}
+
+/* count reads of len bytes, back to back from block 0 or at random aligned offsets */
+static bool bench_pass(const bench_dev_t *dev, bool random, uint32_t len, uint32_t count)
+{
+	const char *pattern = random ? "rand" : "seq";
+	uint32_t	step	= len / BENCH_BLOCK;
+	uint32_t	slots	= dev->blocks / step;
+	uint32_t	blkno, i;
+	uint64_t	start, t;
+	uint32_t	total;
+
+	if (slots == 0)
+		return TRUE;
+
+	start = time_us();
+	for (i = 0; i < count; i++) {
+		blkno = (random ? bench_rand() % slots : i % slots) * step;
+		t	  = time_us();
+		if (!dev->read(dev->ctx, BENCH_BUF, blkno, len)) {
+			message("BENCH,error,%s,%s,%s,%" PRIu32 ",%" PRIu32 "\r\n", dev->name, dev->path, pattern, len, blkno);
+			return FALSE;
+		}
+		bench_lat[i] = time_us() - t;
+	}
+	total = time_us() - start;
+
+	bench_sort(bench_lat, count);
+	message("BENCH,result,%s,%s,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32
+			",%" PRIu32 ",%" PRIu32 "\r\n",
+			dev->name, dev->path, pattern, len, count, total,
+			total ? (uint32_t)((uint64_t)len * count * 1000000 / 1024 / total) : 0, bench_lat[0],
+			bench_pct(count, 50), bench_pct(count, 90), bench_pct(count, 99), bench_lat[count - 1]);
+	return TRUE;
+}
+
+/* The size sweep, each size read sequentially and then at random */
+static void bench_device(const bench_dev_t *dev)
+{
+	uint32_t len, count;
+
+	bench_seed = BENCH_RAND_SEED;
+	for (len = dev->min_len; len <= dev->max_len; len <<= 1) {
+		count = CONFIG_STORAGE_BENCH_SPAN / len;
+		if (count < BENCH_MIN_COUNT)
+			count = BENCH_MIN_COUNT;
+		if (count > BENCH_SAMPLES)
+			count = BENCH_SAMPLES;
+
+		sunxi_wdg_set(BENCH_WDG);
+		if (!bench_pass(dev, FALSE, len, count) || !bench_pass(dev, TRUE, len, count))
+			return;
+	}
+}
+
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+static bool bench_read_idma(void *ctx, u8 *buf, uint32_t blkno, uint32_t len)
+{
+	return sdmmc_blk_read(ctx, buf, blkno, len / BENCH_BLOCK) == len / BENCH_BLOCK;
+}
+
+/* CMD17 through the FIFO, to compare with the same command over IDMA */
+static bool bench_read_pio(void *ctx, u8 *buf, uint32_t blkno, uint32_t len)
+{
+	sdmmc_pdata_t *data = ctx;
+
+	return sdhci_probe_read(data->hci, MMC_READ_SINGLE_BLOCK, data->card.high_capacity ? blkno : blkno * BENCH_BLOCK,
+							(u32 *)buf, len);
+}
+
+static void bench_card(sdmmc_pdata_t *data, const char *name)
+{
+	sdmmc_stats_t before = data->card.stats;
+	sdmmc_stats_t *after = &data->card.stats;
+	bench_dev_t	   dev	 = {
+		   .name	= name,
+		   .path	= "idma",
+		   .blocks	= data->card.capacity / BENCH_BLOCK,
+		   .min_len = BENCH_BLOCK,
+		   .max_len = BENCH_MAX_LEN,
+		   .read	= bench_read_idma,
+		   .ctx		= data,
+	   };
+
+	message("BENCH,dev,%s,%s,%s,%" PRIu32 ",%" PRIu32 "\r\n", name,
+			(data->card.version & MMC_VERSION_MMC) ? "mmc" : "sd", data->card.timing, data->hci->bus_hz,
+			(uint32_t)(data->card.capacity >> 10));
+	bench_device(&dev);
+	message("BENCH,stats,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\r\n", name,
+			after->reads - before.reads, after->sbc_reads - before.sbc_reads, after->cmds - before.cmds,
+			after->status_skipped - before.status_skipped, after->stop_skipped - before.stop_skipped);
+
+	// The SMHC only takes the FIFO path for single blocks
+	dev.path	= "pio";
+	dev.max_len = BENCH_BLOCK;
+	dev.read	= bench_read_pio;
+	bench_device(&dev);
+}
+#endif
+
+#if CONFIG_BOOT_SPINAND
+static bool bench_read_spi(void *ctx, u8 *buf, uint32_t blkno, uint32_t len)
+{
+	return spi_nand_read(ctx, buf, blkno * BENCH_BLOCK, len) != (uint32_t)-1;
+}
+
+static void bench_spi_nand(sunxi_spi_t *spi)
+{
+	spi_nand_info_t *info = &spi->info;
+	uint64_t		 size;
+	bench_dev_t		 dev = {
+			.name	 = "spinand",
+			.path	 = "spi",
+			.min_len = info->page_size,
+			.max_len = BENCH_MAX_LEN,
+			.read	 = bench_read_spi,
+			.ctx	 = spi,
+	};
+
+	size = (uint64_t)info->page_size * info->pages_per_block * info->blocks_per_die * info->ndies;
+	dev.blocks = size / BENCH_BLOCK;
+
+	message("BENCH,dev,spinand,%s,mode%d,%" PRIu32 ",%" PRIu32 "\r\n", info->name, (int)info->mode, spi->clk_rate,
+			(uint32_t)(size >> 10));
+	bench_device(&dev);
+}
+#endif
+
+void storage_bench(void)
+{
+	u32 start = time_ms();
+
+	message("BENCH,begin,%" PRIu32 "\r\n", (u32)BUILD_REVISION);
+
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+	if (card0.online)
+		bench_card(&card0, "card0");
+#if CONFIG_SDMMC_CARD1
+	if (card1.online)
+		bench_card(&card1, "card1");
+#endif
+#endif
+
+#if CONFIG_BOOT_SPINAND
+#if (CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC) && CONFIG_SDMMC_CARD1
+	// card1 is wired to the SPI-NAND pins
+	if (!card1.online)
+#endif
+	{
+		dma_init();
+		if (sunxi_spi_init(&sunxi_spi0) == 0) {
+			if (spi_nand_detect(&sunxi_spi0) == 0)
+				bench_spi_nand(&sunxi_spi0);
+			sunxi_spi_disable(&sunxi_spi0);
+		}
+	}
+#endif
+
+	message("BENCH,end,%" PRIu32 "\r\n", time_ms() - start);
+}
+#endif
@@ -0,0 +1,15 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "board.h"
+
+#if CONFIG_STORAGE_BENCH
+/*
+ * Reads every online card and the SPI-NAND with transfer sizes from 512B to
+ * 8MB, sequentially and at random offsets, and prints one "BENCH," line per
+ * result on the UART. Uses the first 8MB of DRAM, call it before loading.
+ */
+void storage_bench(void);
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __BOOTIDX_H__
+#define __BOOTIDX_H__
+
+#include <stdint.h>
+
+/*
+ * Boot extent index, written by tools/mkbootidx into the reserved sector just
+ * in front of the first FAT (exFAT: the sector before FatOffset). It lists
+ * where the data of the boot files lies so that awboot can load them by LBA
+ * without mounting the volume. Sector numbers are relative to the start of
+ * the volume. The directory entry locations let the loader check a file's
+ * size, mtime and first cluster with one or two sector reads, and fall back
+ * to FatFs when anything changed since the index was written.
+ */
+#define BOOTIDX_MAGIC	   0x58444942 /* "BIDX" */
+#define BOOTIDX_VERSION	   1
+#define BOOTIDX_BLOCK_LEN  512
+#define BOOTIDX_FILES	   3
+#define BOOTIDX_NAME_LEN   32
+#define BOOTIDX_EXTENTS	   37
+#define BOOTIDX_EXFAT_BOOT 24 /* main and backup boot regions */
+
+enum {
+	BOOTIDX_FAT = 1, /* FAT12/16/32 */
+	BOOTIDX_EXFAT,
+};
+
+typedef struct {
+	char	 name[BOOTIDX_NAME_LEN]; /* path in the volume without the leading '/', NUL terminated */
+	uint32_t size;
+	uint32_t mtime; /* FAT: date << 16 | time, exFAT: LastModifiedTimestamp */
+	uint32_t cluster; /* first cluster */
+	uint32_t entry_lba; /* directory entry with the mtime, and on FAT the size and cluster */
+	uint32_t stream_lba; /* exFAT stream extension with the size and cluster, entry_lba on FAT */
+	uint16_t entry_off; /* byte offsets of those entries in their sectors */
+	uint16_t stream_off;
+	uint16_t extent; /* first extent of the file */
+	uint16_t extents;
+} bootidx_file_t;
+
+typedef struct {
+	uint32_t lba;
+	uint32_t count; /* sectors */
+} bootidx_extent_t;
+
+typedef struct {
+	uint32_t		 magic;
+	uint32_t		 version;
+	uint32_t		 checksum; /* makes the 32-bit word sum of the sector zero */
+	uint32_t		 serial; /* volume serial number from the boot sector */
+	uint32_t		 sectors; /* volume size, low 32 bits */
+	uint8_t			 fs_type;
+	uint8_t			 files;
+	uint16_t		 reserved[7];
+	bootidx_file_t	 file[BOOTIDX_FILES];
+	bootidx_extent_t extent[BOOTIDX_EXTENTS];
+} bootidx_t;
+
+_Static_assert(sizeof(bootidx_t) == BOOTIDX_BLOCK_LEN, "bootidx_t must fill one sector");
+
+static inline uint32_t bootidx_sum(const bootidx_t *idx)
+{
+	const uint32_t *word = (const uint32_t *)idx;
+	uint32_t		sum	 = 0;
+	unsigned int	i;
+
+	for (i = 0; i < sizeof(*idx) / 4; i++)
+		sum += word[i];
+	return sum;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __BOOTPART_H__
+#define __BOOTPART_H__
+
+#include <stdint.h>
+
+/*
+ * Header in the first block of an eMMC boot partition, written by
+ * tools/mkbootpart. Offsets count 512-byte blocks from the start of the
+ * partition, sizes are in bytes and a zero size skips the image.
+ */
+#define BOOTPART_MAGIC	   0x54504241 /* "ABPT" */
+#define BOOTPART_VERSION   1
+#define BOOTPART_BLOCK_LEN 512
+
+enum {
+	BOOTPART_DTB = 0,
+	BOOTPART_KERNEL,
+	BOOTPART_INITRD,
+	BOOTPART_IMAGES,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t checksum; /* makes the 32-bit word sum of the header zero */
+	uint32_t reserved;
+	struct {
+		uint32_t offset;
+		uint32_t size;
+	} image[BOOTPART_IMAGES];
+} bootpart_header_t;
+
+static inline uint32_t bootpart_sum(const bootpart_header_t *hdr)
+{
+	const uint32_t *word = (const uint32_t *)hdr;
+	uint32_t		sum	 = 0;
+	unsigned int	i;
+
+	for (i = 0; i < sizeof(*hdr) / 4; i++)
+		sum += word[i];
+	return sum;
+}
+
+#endif
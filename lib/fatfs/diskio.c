@@ -10,16 +10,341 @@
 #include "diskio.h"
 #include "common.h"
 #include "sdmmc.h"
+#include "gpt.h"
 #include "debug.h"
 #include "dram.h"
 #include "sunxi_dma.h"
 #include "board.h"
 
-static DSTATUS Stat = STA_NOINIT; /* Disk status */
+static BYTE ready; /* one bit per initialised drive */
 #ifdef CONFIG_FATFS_CACHE_SIZE
-static u8 *const cache		= (u8 *)SDRAM_BASE;
-static const u32 cache_size = (CONFIG_FATFS_CACHE_SIZE);
-static u32		 cache_first, cache_last;
+/*
+ * LRU cache of 4KB aligned blocks, so that the FAT, directory and BPB
+ * sectors FatFs keeps coming back to stay resident while it walks between
+ * them. Data runs bypass it.
+ */
+#define CACHE_BLOCK_SECTORS 8
+#define CACHE_BLOCKS		(CONFIG_FATFS_CACHE_SIZE / CACHE_BLOCK_SECTORS)
+#define CACHE_EMPTY			0xFFFFFFFF
+
+_Static_assert(CACHE_BLOCKS > 0, "CONFIG_FATFS_CACHE_SIZE must hold at least one 4KB block");
+
+static u8 *const cache = (u8 *)SDRAM_BASE;
+static struct {
+	u32	 lba; /* first sector of the block, CACHE_EMPTY when unused */
+	u32	 used; /* cache_clock at the last access */
+	BYTE drv;
+} cache_tag[CACHE_BLOCKS];
+static u32 cache_clock;
+#endif
+
+/* Requests at least this long (sectors) DMA straight into the caller's buffer */
+#ifndef CONFIG_FATFS_BYPASS_SECTORS
+#define CONFIG_FATFS_BYPASS_SECTORS 8
+#endif
+
+static struct {
+	u32 hits;
+	u32 misses;
+	u32 evictions;
+	u32 bypass_reads;
+	u64 bypass_bytes;
+	u32 trace_hits;
+} stats;
+
+#if CONFIG_BLOCK_TRACE
+/*
+ * The trace is one sector at CONFIG_BLOCK_TRACE_LBA of the boot card: the
+ * metadata reads of a good boot, sorted and merged into extents, each with a
+ * hash of its data. The next boot reads all extents in one batch into
+ * CONFIG_BLOCK_TRACE_BUF before mounting, so the BPB, FAT and directory
+ * sectors come from DRAM. The prefetched data is what is on the card now;
+ * an extent whose hash changed means the volume was modified and the trace
+ * recorded during this boot replaces the old one.
+ */
+#define TRACE_MAGIC		  0x43525442 /* "BTRC" */
+#define TRACE_EXTENTS	  40
+#define TRACE_RECORDS	  256 /* distinct reads kept per boot */
+#define TRACE_MAX_SECTORS 2048 /* size of the prefetch buffer */
+#define TRACE_MERGE_GAP	  8 /* unused sectors read through to join two extents */
+
+typedef struct {
+	u32 lba;
+	u32 count;
+	u32 hash;
+} trace_extent_t;
+
+typedef struct {
+	u32			   magic;
+	u32			   checksum; /* makes the word sum of the sector zero */
+	u32			   blocks; /* card size, the trace belongs to one card */
+	u32			   count;
+	trace_extent_t ext[TRACE_EXTENTS];
+	u32			   reserved[4];
+} trace_block_t;
+
+_Static_assert(sizeof(trace_block_t) == FF_MIN_SS, "trace_block_t must fill one sector");
+
+static trace_block_t trace_old __attribute__((aligned(64)));
+static trace_block_t trace_new __attribute__((aligned(64)));
+static u8 *const	 trace_buf = (u8 *)CONFIG_BLOCK_TRACE_BUF;
+static u32			 trace_off[TRACE_EXTENTS]; /* byte offsets of the extents in trace_buf */
+static u32			 trace_loaded; /* extents of trace_old in trace_buf */
+static u32			 trace_stale; /* of those, extents whose data changed */
+static bool			 trace_recording;
+static bool			 trace_writable; /* the sector is empty or holds a trace */
+
+static struct {
+	u32 lba;
+	u32 count;
+} trace_rec[TRACE_RECORDS];
+static u32 trace_num;
+#endif
+
+/* Drive 0 is the boot card, drive 1 ("1:" paths) the second controller when enabled */
+sdmmc_pdata_t *disk_card(BYTE pdrv)
+{
+	if (pdrv == 0)
+		return &card0;
+#if CONFIG_SDMMC_CARD1
+	if (pdrv == 1 && card1.online)
+		return &card1;
+#endif
+	return NULL;
+}
+
+#if CONFIG_BLOCK_TRACE
+static u32 trace_sum(const void *block)
+{
+	const u32 *word = block;
+	u32		   sum	= 0;
+	u32		   i;
+
+	for (i = 0; i < FF_MIN_SS / 4; i++)
+		sum += word[i];
+	return sum;
+}
+
+static u32 trace_hash(const u8 *buf, u32 sectors)
+{
+	const u32 *word = (const u32 *)buf;
+	u32		   hash = 0x811c9dc5;
+	u32		   i;
+
+	for (i = 0; i < sectors * FF_MIN_SS / 4; i++)
+		hash = ((hash << 5) | (hash >> 27)) ^ word[i];
+	return hash;
+}
+
+static u32 trace_card_blocks(void)
+{
+	return (u32)(card0.card.capacity / FF_MIN_SS);
+}
+
+/* The trace sector has to lie between the partition table and the lowest partition */
+static bool trace_lba_free(void)
+{
+	uint64_t first, end;
+
+	if (gpt_free_range(&card0, trace_buf, TRACE_MAX_SECTORS * FF_MIN_SS, &first, &end) != 0)
+		return FALSE;
+	return CONFIG_BLOCK_TRACE_LBA >= first && CONFIG_BLOCK_TRACE_LBA < end;
+}
+
+/* Reads the extents of a trace back to back into trace_buf */
+static bool trace_fetch(const trace_block_t *trace)
+{
+	sdmmc_run_t runs[SDMMC_MAX_RUNS];
+	u32			i, off = 0;
+	int			num = 0;
+
+	for (i = 0; i < trace->count; i++) {
+		trace_off[i]	 = off;
+		runs[num].data	 = &card0;
+		runs[num].buf	 = trace_buf + off;
+		runs[num].blkno	 = trace->ext[i].lba;
+		runs[num].blkcnt = trace->ext[i].count;
+		off += trace->ext[i].count * FF_MIN_SS;
+		if (++num == SDMMC_MAX_RUNS || i + 1 == trace->count) {
+			if (sdmmc_read_runs(runs, num) != 0)
+				return FALSE;
+			num = 0;
+		}
+	}
+	return TRUE;
+}
+
+void disk_trace_replay(void)
+{
+	u32 i, sectors = 0;
+#if LOG_LEVEL >= LOG_DEBUG
+	u32 start = time_ms();
+#endif
+
+	trace_num		= 0;
+	trace_loaded	= 0;
+	trace_stale		= 0;
+	trace_recording = TRUE;
+
+	if (sdmmc_blk_read(&card0, (u8 *)&trace_old, CONFIG_BLOCK_TRACE_LBA, 1) != 1) {
+		trace_writable = FALSE;
+		return;
+	}
+	if (trace_old.magic != TRACE_MAGIC) {
+		for (i = 0; i < FF_MIN_SS / 4 && !((u32 *)&trace_old)[i]; i++)
+			;
+		trace_writable = i == FF_MIN_SS / 4;
+		if (!trace_writable)
+			warning("BTRACE: sector %" PRIu32 " is in use, no trace kept\r\n", (u32)CONFIG_BLOCK_TRACE_LBA);
+		trace_old.count = 0;
+		return;
+	}
+
+	trace_writable = TRUE;
+	for (i = 0; i < trace_old.count && i < TRACE_EXTENTS; i++)
+		sectors += trace_old.ext[i].count;
+	if (trace_sum(&trace_old) != 0 || trace_old.blocks != trace_card_blocks() || trace_old.count > TRACE_EXTENTS ||
+		sectors > TRACE_MAX_SECTORS) {
+		warning("BTRACE: trace not valid for this card, recording a new one\r\n");
+		trace_old.count = 0;
+		return;
+	}
+	if (!trace_fetch(&trace_old)) {
+		warning("BTRACE: prefetch failed\r\n");
+		trace_old.count = 0;
+		return;
+	}
+
+	for (i = 0; i < trace_old.count; i++) {
+		if (trace_hash(trace_buf + trace_off[i], trace_old.ext[i].count) != trace_old.ext[i].hash)
+			trace_stale++;
+	}
+	trace_loaded = trace_old.count;
+	if (trace_stale)
+		info("BTRACE: %" PRIu32 " of %" PRIu32 " extents changed, the trace will be rewritten\r\n", trace_stale,
+			 trace_loaded);
+#if LOG_LEVEL >= LOG_DEBUG
+	debug("BTRACE: prefetched %" PRIu32 " extents, %" PRIu32 " sectors in %" PRIu32 "ms\r\n", trace_loaded, sectors,
+		  time_ms() - start);
+#endif
+}
+
+static void trace_record(u32 lba, u32 count)
+{
+	u32 i;
+
+	for (i = 0; i < trace_num; i++) {
+		if (trace_rec[i].lba == lba && trace_rec[i].count >= count)
+			return;
+	}
+	if (trace_num < TRACE_RECORDS) {
+		trace_rec[trace_num].lba   = lba;
+		trace_rec[trace_num].count = count;
+		trace_num++;
+	}
+}
+
+/* Copies a read out of the prefetched extents, FALSE when one of them does not hold all of it */
+static bool trace_lookup(BYTE *buff, u32 lba, u32 count)
+{
+	const trace_extent_t *ext;
+	u32					  i;
+
+	for (i = 0; i < trace_loaded; i++) {
+		ext = &trace_old.ext[i];
+		if (lba >= ext->lba && lba + count <= ext->lba + ext->count) {
+			memcpy(buff, trace_buf + trace_off[i] + (lba - ext->lba) * FF_MIN_SS, count * FF_MIN_SS);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Merges the sorted records into extents, FALSE if they do not fit the trace with this gap */
+static bool trace_build(u32 gap)
+{
+	trace_extent_t *ext = NULL;
+	u32				i, end, sectors = 0;
+
+	trace_new.count = 0;
+	for (i = 0; i < trace_num; i++) {
+		end = trace_rec[i].lba + trace_rec[i].count;
+		if (ext && trace_rec[i].lba <= ext->lba + ext->count + gap) {
+			if (end > ext->lba + ext->count) {
+				sectors += end - (ext->lba + ext->count);
+				ext->count = end - ext->lba;
+			}
+			continue;
+		}
+		if (trace_new.count == TRACE_EXTENTS)
+			return FALSE;
+		ext		   = &trace_new.ext[trace_new.count++];
+		ext->lba   = trace_rec[i].lba;
+		ext->count = trace_rec[i].count;
+		ext->hash  = 0;
+		sectors += ext->count;
+	}
+	return sectors <= TRACE_MAX_SECTORS;
+}
+
+void disk_trace_save(void)
+{
+	u32 i, j, gap, lba, count;
+
+	if (!trace_recording)
+		return;
+	trace_recording = FALSE;
+	if (!trace_writable || !trace_num)
+		return;
+
+	// Sort by LBA, there are a few dozen records
+	for (i = 1; i < trace_num; i++) {
+		lba	  = trace_rec[i].lba;
+		count = trace_rec[i].count;
+		for (j = i; j > 0 && trace_rec[j - 1].lba > lba; j--)
+			trace_rec[j] = trace_rec[j - 1];
+		trace_rec[j].lba   = lba;
+		trace_rec[j].count = count;
+	}
+	// Wider gaps until it fits, a partial trace still saves most of the reads
+	for (gap = TRACE_MERGE_GAP; !trace_build(gap) && gap < TRACE_MAX_SECTORS; gap *= 2)
+		;
+	while (!trace_build(gap) && trace_num > 1)
+		trace_num--;
+
+	if (!trace_stale && trace_new.count == trace_old.count) {
+		for (i = 0; i < trace_new.count; i++) {
+			if (trace_new.ext[i].lba != trace_old.ext[i].lba || trace_new.ext[i].count != trace_old.ext[i].count)
+				break;
+		}
+		if (i == trace_new.count)
+			return;
+	}
+
+	trace_loaded = 0;
+	if (!trace_fetch(&trace_new)) {
+		warning("BTRACE: read failed, trace not saved\r\n");
+		return;
+	}
+	for (i = 0; i < trace_new.count; i++)
+		trace_new.ext[i].hash = trace_hash(trace_buf + trace_off[i], trace_new.ext[i].count);
+	trace_new.magic	   = TRACE_MAGIC;
+	trace_new.blocks   = trace_card_blocks();
+	trace_new.checksum = 0;
+	trace_new.checksum = -trace_sum(&trace_new);
+
+	// trace_buf is free again and serves as scratch for the partition table
+	if (!trace_lba_free()) {
+		warning("BTRACE: sector %" PRIu32 " is not ahead of the first partition, trace not saved\r\n",
+				(u32)CONFIG_BLOCK_TRACE_LBA);
+		return;
+	}
+	if (sdmmc_blk_write(&card0, (u8 *)&trace_new, CONFIG_BLOCK_TRACE_LBA, 1) != 1) {
+		warning("BTRACE: trace not saved\r\n");
+		return;
+	}
+	info("BTRACE: saved %" PRIu32 " extents for the next boot\r\n", trace_new.count);
+}
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -29,15 +354,10 @@ static u32		 cache_first, cache_last;
 DSTATUS disk_status(BYTE pdrv /* Physical drive nmuber to identify the drive */
 )
 {
-	if (pdrv)
+	if (!disk_card(pdrv))
 		return STA_NOINIT;
 
-#ifdef CONFIG_FATFS_CACHE_SIZE
-	cache_first = 0xFFFFFFFF - cache_size; // Set to a big sector for a proper init
-	cache_last	= 0xFFFFFFFF;
-#endif
-
-	return Stat;
+	return (ready & (1 << pdrv)) ? 0 : STA_NOINIT;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -47,13 +367,65 @@ DSTATUS disk_status(BYTE pdrv /* Physical drive nmuber to identify the drive */
 DSTATUS disk_initialize(BYTE pdrv /* Physical drive nmuber to identify the drive */
 )
 {
-	if (pdrv)
+#ifdef CONFIG_FATFS_CACHE_SIZE
+	int i;
+#endif
+
+	if (!disk_card(pdrv))
 		return STA_NOINIT;
 
-	Stat &= ~STA_NOINIT;
+#ifdef CONFIG_FATFS_CACHE_SIZE
+	// A new mount, and the cache memory may have been used since (storage benchmark)
+	for (i = 0; i < CACHE_BLOCKS; i++) {
+		if (cache_tag[i].drv == pdrv || !(ready & (1 << cache_tag[i].drv))) {
+			cache_tag[i].lba  = CACHE_EMPTY;
+			cache_tag[i].used = 0;
+		}
+	}
+#endif
+
+	ready |= 1 << pdrv;
+
+	return 0;
+}
+
+#ifdef CONFIG_FATFS_CACHE_SIZE
+/* The cached block holding a sector, read into the least recently used slot on a miss. NULL on a read error */
+static u8 *cache_block(sdmmc_pdata_t *card, BYTE pdrv, u32 sector)
+{
+	u32 lba	   = sector & ~(CACHE_BLOCK_SECTORS - 1);
+	u32 blocks = (u32)(card->card.capacity / FF_MIN_SS);
+	u32 count  = blocks - lba < CACHE_BLOCK_SECTORS ? blocks - lba : CACHE_BLOCK_SECTORS;
+	u8 *buf;
+	int i, victim = 0;
+
+	for (i = 0; i < CACHE_BLOCKS; i++) {
+		if (cache_tag[i].lba == lba && cache_tag[i].drv == pdrv) {
+			stats.hits++;
+			cache_tag[i].used = ++cache_clock;
+			return cache + i * CACHE_BLOCK_SECTORS * FF_MIN_SS;
+		}
+		if (cache_tag[i].used < cache_tag[victim].used)
+			victim = i; // empty slots have used == 0
+	}
 
-	return Stat;
+	stats.misses++;
+	if (cache_tag[victim].lba != CACHE_EMPTY)
+		stats.evictions++;
+	buf = cache + victim * CACHE_BLOCK_SECTORS * FF_MIN_SS;
+	if (sdmmc_blk_read(card, buf, lba, count) != count) {
+		warning("FATFS: MMC read of %" PRIu32 " blocks at %" PRIu32 " failed\r\n", count, lba);
+		cache_tag[victim].lba  = CACHE_EMPTY;
+		cache_tag[victim].used = 0;
+		return NULL;
+	}
+	cache_tag[victim].lba  = lba;
+	cache_tag[victim].drv  = pdrv;
+	cache_tag[victim].used = ++cache_clock;
+	trace("FATFS: cached sectors %" PRIu32 "-%" PRIu32 " in slot %d\r\n", lba, lba + count - 1, victim);
+	return buf;
 }
+#endif
 
 /*-----------------------------------------------------------------------*/
 /* Read Sector(s)                                                        */
@@ -65,11 +437,16 @@ DRESULT disk_read(BYTE	pdrv, /* Physical drive nmuber to identify the drive */
 				  UINT	count /* Number of sectors to read */
 )
 {
-	u32 blkread, read_pos, first, last, chunk, bytes;
+	sdmmc_pdata_t *card = disk_card(pdrv);
+	u32			   blkread, first, last, bytes;
+#ifdef CONFIG_FATFS_CACHE_SIZE
+	u32 offset, chunk;
+	u8 *block;
+#endif
 
-	if (pdrv || !count)
+	if (!card || !count)
 		return RES_PARERR;
-	if (Stat & STA_NOINIT)
+	if (!(ready & (1 << pdrv)))
 		return RES_NOTRDY;
 
 	first = sector;
@@ -78,42 +455,62 @@ DRESULT disk_read(BYTE	pdrv, /* Physical drive nmuber to identify the drive */
 
 	trace("FATFS: read %" PRIu32 " sectors at %" PRIu32 "\r\n", (uint32_t)count, first);
 
-#ifdef CONFIG_FATFS_CACHE_SIZE
-	// Read starts in cache but overflows
-	if (first >= cache_first && first < cache_last && last > cache_last) {
-		chunk = (cache_last - first) * FF_MIN_SS;
-		memcpy(buff, cache + (first - cache_first) * FF_MIN_SS, chunk);
-		buff += chunk;
-		first += (cache_last - first);
-		trace("FATFS: chunk %" PRIu32 " first %" PRIu32 "\r\n", (uint32_t)chunk, first);
-	}
-
-	// Read is NOT in the cache
-	if (last > cache_last || first < cache_first) {
-		trace("FATFS: if %" PRIu32 " > %" PRIu32 " || %" PRIu32 " < %" PRIu32 "\r\n", last, cache_last, first,
-			  cache_first);
-
-		read_pos	= (first / cache_size) * cache_size; // TODO: check with card max capacity
-		cache_first = read_pos;
-		cache_last	= read_pos + cache_size;
-		blkread		= sdmmc_blk_read(&card0, cache, read_pos, cache_size);
-
-		if (blkread != cache_size) {
-			warning("FATFS: MMC read %" PRIu32 "/%" PRIu32 " blocks\r\n", blkread, cache_size);
+	// Large data runs skip the cache, metadata (BPB, FAT, directory) stays cached
+	if (count >= CONFIG_FATFS_BYPASS_SECTORS && !((uintptr_t)buff & 0x3)) {
+		blkread = sdmmc_blk_read(card, buff, sector, count);
+		if (blkread != count) {
+			warning("FATFS: MMC read %" PRIu32 "/%" PRIu32 " blocks\r\n", blkread, (u32)count);
 			return RES_ERROR;
 		}
-		trace("FATFS: cached %" PRIu32 " sectors (%" PRIu32 "KB) at %" PRIu32 "/[%" PRIu32 "-%" PRIu32 "]\r\n", blkread,
-			  (blkread * FF_MIN_SS) / 1024, first, read_pos, read_pos + cache_size);
+		stats.bypass_reads++;
+		stats.bypass_bytes += bytes;
+		return RES_OK;
 	}
 
-	// Copy from read cache to output buffer
-	trace("FATFS: copy %" PRIu32 " from 0x%p to 0x%p\r\n", bytes, (void *)(cache + ((first - cache_first) * FF_MIN_SS)),
-		  (void *)buff);
-	memcpy(buff, (cache + ((first - cache_first) * FF_MIN_SS)), bytes);
+#if CONFIG_BLOCK_TRACE
+	if (pdrv == 0 && trace_recording) {
+		trace_record(first, count);
+		if (trace_lookup(buff, first, count)) {
+			stats.trace_hits++;
+			return RES_OK;
+		}
+	}
+#endif
+
+#ifdef CONFIG_FATFS_CACHE_SIZE
+	while (first < last) {
+		block = cache_block(card, pdrv, first);
+		if (!block)
+			return RES_ERROR;
+		offset = first % CACHE_BLOCK_SECTORS;
+		chunk  = CACHE_BLOCK_SECTORS - offset;
+		if (chunk > last - first)
+			chunk = last - first;
+		memcpy(buff, block + offset * FF_MIN_SS, chunk * FF_MIN_SS);
+		buff += chunk * FF_MIN_SS;
+		first += chunk;
+	}
 
 	return RES_OK;
 #else
-	return (sdmmc_blk_read(&card0, buff, sector, count) == count ? RES_OK : RES_ERROR);
+	return (sdmmc_blk_read(card, buff, sector, count) == count ? RES_OK : RES_ERROR);
+#endif
+}
+
+/*-----------------------------------------------------------------------*/
+/* Cache statistics                                                      */
+/*-----------------------------------------------------------------------*/
+
+void disk_log_stats(BYTE pdrv)
+{
+	if (pdrv)
+		return;
+
+	debug("FATFS: cache %" PRIu32 " hits, %" PRIu32 " misses, %" PRIu32 " evictions, %" PRIu32 " direct reads (%" PRIu32
+		  "KB)\r\n",
+		  stats.hits, stats.misses, stats.evictions, stats.bypass_reads, (u32)(stats.bypass_bytes / 1024));
+#if CONFIG_BLOCK_TRACE
+	debug("FATFS: %" PRIu32 " reads from the block trace\r\n", stats.trace_hits);
 #endif
 }
 
@@ -5,6 +5,8 @@
 #ifndef _DISKIO_DEFINED
 #define _DISKIO_DEFINED
 
+#include "sdmmc.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +31,21 @@ DSTATUS disk_status(BYTE pdrv);
 DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
 DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff);
+void	disk_log_stats(BYTE pdrv);
+
+/* The card behind a drive, NULL when it is not available */
+sdmmc_pdata_t *disk_card(BYTE pdrv);
+
+#if CONFIG_BLOCK_TRACE
+/*
+ * Block trace of the boot card: disk_trace_replay() prefetches the sectors
+ * FatFs read on the last good boot and starts recording this boot's reads,
+ * call it before mounting. disk_trace_save() writes the new trace once the
+ * images are loaded, when it differs from the old one.
+ */
+void disk_trace_replay(void);
+void disk_trace_save(void);
+#endif
 
 /* Disk Status Bits (DSTATUS) */
 
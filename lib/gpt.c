@@ -0,0 +1,192 @@
+#include "common.h"
+#include "gpt.h"
+
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+
+#define GPT_BLOCK_LEN		512
+#define GPT_SIGNATURE		"EFI PART"
+#define GPT_HEADER_LBA		1
+#define GPT_MIN_HEADER_SIZE 92
+#define GPT_MIN_ENTRY_SIZE	128
+#define MBR_TYPE_PROTECTIVE 0xee
+#define MBR_PART_TABLE		446
+
+/* Offsets in the GPT header */
+#define GPT_HDR_SIZE		12
+#define GPT_HDR_CRC			16
+#define GPT_HDR_ENTRIES_LBA 72
+#define GPT_HDR_NUM_ENTRIES 80
+#define GPT_HDR_ENTRY_SIZE	84
+#define GPT_HDR_ENTRIES_CRC 88
+
+/* Offsets in a partition entry */
+#define GPT_ENT_TYPE	  0
+#define GPT_ENT_FIRST_LBA 32
+#define GPT_ENT_LAST_LBA  40
+#define GPT_ENT_NAME	  56
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	int bit;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static bool mbr_is_protective(const uint8_t *mbr)
+{
+	int i;
+
+	if (mbr[510] != 0x55 || mbr[511] != 0xaa)
+		return FALSE;
+	for (i = 0; i < 4; i++) {
+		if (mbr[MBR_PART_TABLE + i * 16 + 4] == MBR_TYPE_PROTECTIVE)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+int gpt_read(sdmmc_pdata_t *data, gpt_t *gpt, uint8_t *scratch, uint32_t scratch_size)
+{
+	uint8_t	 hdr[GPT_BLOCK_LEN];
+	uint32_t hdr_size, crc, blocks;
+	uint64_t entries_lba;
+
+	if (scratch_size < 2 * GPT_BLOCK_LEN || sdmmc_blk_read(data, scratch, 0, 2) != 2) {
+		error("GPT: cannot read the partition table\r\n");
+		return -1;
+	}
+	if (!mbr_is_protective(scratch)) {
+		debug("GPT: no protective MBR\r\n");
+		return -1;
+	}
+
+	memcpy(hdr, scratch + GPT_BLOCK_LEN, GPT_BLOCK_LEN);
+	hdr_size = get_le32(hdr + GPT_HDR_SIZE);
+	if (memcmp(hdr, GPT_SIGNATURE, 8) || hdr_size < GPT_MIN_HEADER_SIZE || hdr_size > GPT_BLOCK_LEN) {
+		error("GPT: bad header\r\n");
+		return -1;
+	}
+
+	crc = get_le32(hdr + GPT_HDR_CRC);
+	memset(hdr + GPT_HDR_CRC, 0, 4);
+	if (crc32(0, hdr, hdr_size) != crc) {
+		error("GPT: header CRC mismatch\r\n");
+		return -1;
+	}
+
+	entries_lba		= get_le64(hdr + GPT_HDR_ENTRIES_LBA);
+	gpt->num		= get_le32(hdr + GPT_HDR_NUM_ENTRIES);
+	gpt->entry_size = get_le32(hdr + GPT_HDR_ENTRY_SIZE);
+	if (gpt->entry_size < GPT_MIN_ENTRY_SIZE || (gpt->entry_size % 8) ||
+		(uint64_t)gpt->num * gpt->entry_size > scratch_size) {
+		error("GPT: unsupported entry array (%" PRIu32 " x %" PRIu32 ")\r\n", gpt->num, gpt->entry_size);
+		return -1;
+	}
+
+	// The whole entry array in one read
+	blocks = (gpt->num * gpt->entry_size + GPT_BLOCK_LEN - 1) / GPT_BLOCK_LEN;
+	if (sdmmc_blk_read(data, scratch, entries_lba, blocks) != blocks) {
+		error("GPT: cannot read the partition entries\r\n");
+		return -1;
+	}
+	if (crc32(0, scratch, gpt->num * gpt->entry_size) != get_le32(hdr + GPT_HDR_ENTRIES_CRC)) {
+		error("GPT: partition entries CRC mismatch\r\n");
+		return -1;
+	}
+
+	gpt->data		 = data;
+	gpt->entries	 = scratch;
+	gpt->entries_end = entries_lba + blocks;
+	debug("GPT: %" PRIu32 " entries at LBA %" PRIu32 "\r\n", gpt->num, (uint32_t)entries_lba);
+	return 0;
+}
+
+static bool name_matches(const uint8_t *utf16, const char *name)
+{
+	int i;
+
+	for (i = 0; i < GPT_NAME_LEN; i++, utf16 += 2) {
+		uint16_t c = utf16[0] | (utf16[1] << 8);
+
+		if (c != (uint8_t)name[i])
+			return FALSE;
+		if (c == 0)
+			return TRUE;
+	}
+	return name[i] == '\0';
+}
+
+int gpt_find(const gpt_t *gpt, const char *name, gpt_part_t *part)
+{
+	static const uint8_t unused[16] = {0};
+	const uint8_t		*entry;
+	uint32_t			 i;
+
+	for (i = 0; i < gpt->num; i++) {
+		entry = gpt->entries + i * gpt->entry_size;
+		if (!memcmp(entry + GPT_ENT_TYPE, unused, sizeof(unused)) || !name_matches(entry + GPT_ENT_NAME, name))
+			continue;
+
+		part->data		= gpt->data;
+		part->first_lba = get_le64(entry + GPT_ENT_FIRST_LBA);
+		part->last_lba	= get_le64(entry + GPT_ENT_LAST_LBA);
+		if (part->last_lba < part->first_lba)
+			return -1;
+		return 0;
+	}
+	return -1;
+}
+
+int gpt_free_range(sdmmc_pdata_t *data, uint8_t *scratch, uint32_t scratch_size, uint64_t *first, uint64_t *end)
+{
+	static const uint8_t unused[16] = {0};
+	const uint8_t		*entry;
+	gpt_t				 gpt;
+	uint64_t			 lba;
+	uint32_t			 i;
+
+	if (scratch_size < GPT_BLOCK_LEN || sdmmc_blk_read(data, scratch, 0, 1) != 1)
+		return -1;
+	if (scratch[510] != 0x55 || scratch[511] != 0xaa)
+		return -1;
+
+	*end = data->card.capacity / GPT_BLOCK_LEN;
+	if (!mbr_is_protective(scratch)) {
+		*first = 1;
+		for (i = 0; i < 4; i++) {
+			entry = scratch + MBR_PART_TABLE + i * 16;
+			lba	  = get_le32(entry + 8);
+			if (entry[4] && get_le32(entry + 12) && lba < *end)
+				*end = lba;
+		}
+		return 0;
+	}
+
+	if (gpt_read(data, &gpt, scratch, scratch_size) != 0)
+		return -1;
+	*first = gpt.entries_end;
+	for (i = 0; i < gpt.num; i++) {
+		entry = gpt.entries + i * gpt.entry_size;
+		lba	  = get_le64(entry + GPT_ENT_FIRST_LBA);
+		if (memcmp(entry + GPT_ENT_TYPE, unused, sizeof(unused)) && lba < *end)
+			*end = lba;
+	}
+	return 0;
+}
+#endif
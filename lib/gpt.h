@@ -0,0 +1,41 @@
+#ifndef __GPT_H__
+#define __GPT_H__
+
+#include "board.h"
+
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+#include "sdmmc.h"
+
+#define GPT_NAME_LEN 36 /* UTF-16 code units */
+
+typedef struct {
+	sdmmc_pdata_t *data; /* card holding the partition */
+	uint64_t	   first_lba;
+	uint64_t	   last_lba; /* inclusive */
+} gpt_part_t;
+
+typedef struct {
+	sdmmc_pdata_t *data;
+	const uint8_t *entries; /* entry array, left in the caller's scratch buffer */
+	uint32_t	   num;
+	uint32_t	   entry_size;
+	uint64_t	   entries_end; /* first LBA after the entry array */
+} gpt_t;
+
+/*
+ * gpt_read() checks the protective MBR and the primary GPT header and loads
+ * the CRC checked entry array into scratch, which must be DMA capable.
+ * gpt_find() then matches a partition by its (ASCII) name.
+ */
+int gpt_read(sdmmc_pdata_t *data, gpt_t *gpt, uint8_t *scratch, uint32_t scratch_size);
+int gpt_find(const gpt_t *gpt, const char *name, gpt_part_t *part);
+
+/*
+ * gpt_free_range() reports the sectors [*first, *end) that lie after the
+ * partition table (MBR or GPT entry array) and before the lowest partition.
+ * It fails on a card without an MBR signature.
+ */
+int gpt_free_range(sdmmc_pdata_t *data, uint8_t *scratch, uint32_t scratch_size, uint64_t *first, uint64_t *end);
+#endif
+
+#endif
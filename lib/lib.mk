@@ -6,8 +6,10 @@ USE_SDMMC = $(shell grep -E "^\#define CONFIG_BOOT_(SDCARD|MMC)" board.h)
 
 ifneq ($(USE_SDMMC),)
 SRCS	+=  $(LIB)/loaders.c
+SRCS	+=  $(LIB)/gpt.c
 endif
 
+SRCS	+=  $(LIB)/bench.c
 SRCS	+=  $(LIB)/fdt.c
 SRCS	+=  $(LIB)/debug.c
 SRCS	+=  $(LIB)/string.c
@@ -1,15 +1,29 @@
 #include "common.h"
 #include "loaders.h"
 #include "board.h"
-#if CONFIG_BOOT_SPINAND
+#if CONFIG_BOOT_SPINAND || CONFIG_MMC_BOOT_PART || CONFIG_SDMMC_GPT_BOOT
 #include "fdt.h"
 #endif
 
 #if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
 
 #include "sdmmc.h"
+#include "diskio.h"
+#if CONFIG_MMC_BOOT_PART
+#include "bootpart.h"
+#endif
+#if CONFIG_SDMMC_GPT_BOOT
+#include "gpt.h"
+#endif
+#if CONFIG_FAT_BOOT_INDEX
+#include "bootidx.h"
+#endif
 
-FATFS fs;
+FATFS		fs;
+static bool fs_mounted;
+#if CONFIG_SDMMC_CARD1
+static FATFS fs1; // "1:" paths, on card1
+#endif
 
 #ifndef CLTBL_DWORDS
 #define CLTBL_DWORDS 2000U
@@ -19,32 +33,45 @@ FATFS fs;
 #define READ_CHUNK (32U * 1024U)
 #endif
 
-static FRESULT read_stream(const char *path, void (*consume)(const uint8_t *, UINT))
+static DWORD cltbl[CLTBL_DWORDS];
+
+static FRESULT open_linked(FIL *file, const char *path)
 {
 	FRESULT fret;
-	FIL	file;
-	UINT	bytes_read = 0U;
 
-	if ((path == NULL) || (consume == NULL))
-		return FR_INVALID_PARAMETER;
-
-	fret = f_open(&file, path, FA_READ);
+	fret = f_open(file, path, FA_READ);
 	if (fret != FR_OK)
 		return fret;
 
-	static DWORD cltbl[CLTBL_DWORDS];
-	cltbl[0]    = CLTBL_DWORDS;
-	file.cltbl  = cltbl;
-	fret = f_lseek(&file, CREATE_LINKMAP);
-	if (fret == FR_NOT_ENOUGH_CORE) {
-		f_close(&file);
-		return fret;
-	}
+	cltbl[0]	= CLTBL_DWORDS;
+	file->cltbl = cltbl;
+	fret		= f_lseek(file, CREATE_LINKMAP);
 	if (fret != FR_OK) {
-		f_close(&file);
+		file->cltbl = NULL;
+		f_close(file);
 		return fret;
 	}
 
+	return FR_OK;
+}
+
+/*
+ * Streaming reader: hands the file to consume() in READ_CHUNK pieces through
+ * a static bounce buffer. Use read_file() to load an image in place.
+ */
+FRESULT read_stream(const char *path, void (*consume)(const uint8_t *, UINT))
+{
+	FRESULT fret;
+	FIL		file;
+	UINT	bytes_read = 0U;
+
+	if ((path == NULL) || (consume == NULL))
+		return FR_INVALID_PARAMETER;
+
+	fret = open_linked(&file, path);
+	if (fret != FR_OK)
+		return fret;
+
 	static uint8_t buf[READ_CHUNK];
 	FRESULT     read_result = FR_OK;
 	do {
@@ -65,45 +92,103 @@ static FRESULT read_stream(const char *path, void (*consume)(const uint8_t *, UI
 	return close_result;
 }
 
-typedef struct {
-	uint8_t *dest;
-	u32	 total;
-} read_copy_state_t;
-
-static read_copy_state_t read_copy_state;
-
-static void read_copy_consume(const uint8_t *buf, UINT len)
+/*
+ * Turns the link map of an open file into (LBA, length) extents and reads
+ * every whole sector from the card straight into place, one command chain
+ * per extent, so a contiguous file is a single transfer. Only a partial
+ * last sector goes through FatFS.
+ */
+static FRESULT read_extents(FIL *file, const char *path, uint8_t *dest, UINT *total)
 {
-	memcpy(read_copy_state.dest, buf, (size_t)len);
-	read_copy_state.dest += (size_t)len;
-	read_copy_state.total += (u32)len;
+	FATFS		  *fs	 = file->obj.fs;
+	const DWORD	  *map	 = file->cltbl + 1; // (clusters, first cluster) pairs, 0 terminated
+	uint32_t	   left	 = f_size(file) / FF_MAX_SS;
+	uint32_t	   tail	 = f_size(file) % FF_MAX_SS;
+	sdmmc_run_t	   runs[SDMMC_MAX_RUNS];
+	int			   num_runs = 0;
+	uint32_t	   extents = 0, gap, max_gap = 0;
+	uint32_t	   sectors;
+	LBA_t		   lba, next = 0;
+	UINT		   br;
+	FRESULT		   fret;
+
+	for (; left && map[0]; map += 2) {
+		lba		= fs->database + (LBA_t)(map[1] - 2) * fs->csize;
+		sectors = map[0] * fs->csize;
+		if (sectors > left)
+			sectors = left;
+
+		if (extents) {
+			gap = lba > next ? lba - next : next - lba;
+			if (gap > max_gap)
+				max_gap = gap;
+		}
+		extents++;
+		next = lba + sectors;
+
+		runs[num_runs].data	  = disk_card(fs->pdrv);
+		runs[num_runs].buf	  = dest;
+		runs[num_runs].blkno  = lba;
+		runs[num_runs].blkcnt = sectors;
+		if (++num_runs == SDMMC_MAX_RUNS) {
+			if (sdmmc_read_runs(runs, num_runs) != 0)
+				return FR_DISK_ERR;
+			num_runs = 0;
+		}
+		dest += sectors * FF_MAX_SS;
+		*total += sectors * FF_MAX_SS;
+		left -= sectors;
+	}
+	if (left)
+		return FR_INT_ERR; // cluster chain shorter than the file
+	if (num_runs && sdmmc_read_runs(runs, num_runs) != 0)
+		return FR_DISK_ERR;
+
+	if (tail) {
+		fret = f_lseek(file, *total);
+		if (fret == FR_OK)
+			fret = f_read(file, dest, tail, &br);
+		if (fret != FR_OK)
+			return fret;
+		*total += br;
+	}
+
+	if (extents > 1)
+		info("FATFS: %s in %" PRIu32 " extents, largest gap %" PRIu32 " sectors\r\n", path, extents, max_gap);
+	else
+		debug("FATFS: %s contiguous\r\n", path);
+	return FR_OK;
 }
 
-void sdmmc_speed_test(void)
+/* Loads a whole file in place through its extents */
+static FRESULT read_direct(const char *path, uint8_t *dest, UINT *total)
 {
-	u32 start = time_ms();
-	u32 test_time;
-	u32 kb_tested;
-	u32 kb_per_second;
-
-	sdmmc_blk_read(&card0, (u8 *)(SDRAM_BASE), 0, CONFIG_SDMMC_SPEED_TEST_SIZE);
-	test_time	  = time_ms() - start;
-	kb_tested	  = (CONFIG_SDMMC_SPEED_TEST_SIZE * 512U) / 1024U;
-	kb_per_second = (test_time == 0U) ? 0U : (CONFIG_SDMMC_SPEED_TEST_SIZE * 512U) / test_time;
-	if (kb_per_second < 1000) {
-		info("SDMMC: speedtest %" PRIu32 "KB in %" PRIu32 "ms at %" PRIu32 "KB/S\r\n", kb_tested, test_time,
-			 kb_per_second);
-	} else {
-		u32 mb_per_second = kb_per_second / 1024;
-		info("SDMMC: speedtest %" PRIu32 "KB in %" PRIu32 "ms at %" PRIu32 "MB/S\r\n", kb_tested, test_time,
-			 mb_per_second);
-	}
+	FRESULT fret;
+	FIL		file;
+
+	*total = 0U;
+
+	fret = open_linked(&file, path);
+	if (fret != FR_OK)
+		return fret;
+
+	FRESULT read_result = read_extents(&file, path, dest, total);
+
+	file.cltbl			 = NULL;
+	FRESULT close_result = f_close(&file);
+	if (read_result != FR_OK)
+		return read_result;
+	return close_result;
 }
 
-int mount_sdmmc()
+static int mount_fat(void)
 {
 	FRESULT fret;
 
+#if CONFIG_BLOCK_TRACE
+	disk_trace_replay();
+#endif
+
 	/* mount fs */
 	fret = f_mount(&fs, "", 1);
 	if (fret != FR_OK) {
@@ -113,13 +198,41 @@ int mount_sdmmc()
 		debug("FATFS: mount OK\r\n");
 	}
 
+	fs_mounted = TRUE;
+
+#if CONFIG_SDMMC_CARD1
+	if (card1.online) {
+		fret = f_mount(&fs1, "1:", 1);
+		if (fret != FR_OK)
+			warning("FATFS: card1 mount error: %d\r\n", fret);
+	}
+#endif
 	return 0;
 }
 
+int mount_sdmmc()
+{
+#if CONFIG_SDMMC_GPT_BOOT || CONFIG_FAT_BOOT_INDEX
+	// Raw partitions and indexed files need no filesystem, load_sdmmc() mounts FAT only as a fallback
+	return 0;
+#else
+	return mount_fat();
+#endif
+}
+
 void unmount_sdmmc(void)
 {
 	FRESULT fret;
 
+	disk_log_stats(0);
+	if (!fs_mounted)
+		return;
+	fs_mounted = FALSE;
+
+#if CONFIG_SDMMC_CARD1
+	f_mount(0, "1:", 0);
+#endif
+
 	/* umount fs */
 	fret = f_mount(0, "", 0);
 	if (fret != FR_OK) {
@@ -144,34 +257,474 @@ int read_file(const char *filename, uint8_t *dest)
 	u32 start = time_ms();
 #endif
 
-	read_copy_state.dest  = dest;
-	read_copy_state.total = 0U;
+	if ((uintptr_t)dest & 0x3) {
+		error("FATFS: destination 0x%p not word aligned\r\n", (void *)dest);
+		return -1;
+	}
 
-	FRESULT fret = read_stream(filename, read_copy_consume);
+	UINT	total_bytes = 0U;
+	FRESULT fret		= read_direct(filename, dest, &total_bytes);
 	if (fret != FR_OK) {
-		read_copy_state.dest  = NULL;
-		read_copy_state.total = 0U;
 		error("FATFS: file read: [%s]: error %d\r\n", filename, fret);
 		return -1;
 	}
 
-	u32 total_bytes = read_copy_state.total;
-
 #if LOG_LEVEL >= LOG_DEBUG
 	u32 duration	 = time_ms() - start + 1U;
 	f32 throughput = ((f32)total_bytes / (f32)duration) / 1024.0f;
 	debug("FATFS: %s read in %" PRIu32 "ms at %.2fMB/S\r\n", filename, duration, throughput);
 #endif
 
-	read_copy_state.dest  = NULL;
-	read_copy_state.total = 0U;
 	return (int)total_bytes;
 }
 
+#if CONFIG_SDMMC_GPT_BOOT
+/* The kernel area is free until the kernel is loaded, the GPT entry array goes there first */
+#define GPT_SCRATCH_SIZE MB(1)
+
+/* Fills a read of the first size bytes of a partition */
+static int gpt_part_run(const gpt_part_t *part, const char *name, uint8_t *dest, uint32_t size, sdmmc_run_t *run)
+{
+	run->data	= part->data;
+	run->buf	= dest;
+	run->blkno	= part->first_lba;
+	run->blkcnt = (size + 511) / 512;
+	if (run->blkcnt > part->last_lba - part->first_lba + 1) {
+		error("GPT: %s (%" PRIu32 " bytes) does not fit its partition\r\n", name, size);
+		return -1;
+	}
+	return 0;
+}
+
+static int read_gpt_part(const gpt_part_t *part, const char *name, uint8_t *dest, uint32_t size)
+{
+	sdmmc_run_t run;
+
+	if (gpt_part_run(part, name, dest, size, &run) != 0)
+		return -1;
+	if (sdmmc_blk_read(run.data, run.buf, run.blkno, run.blkcnt) != run.blkcnt) {
+		error("GPT: %s read failed\r\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+/* Partitions are looked up on card0 first, then on card1 */
+static int find_gpt_part(const gpt_t *gpt, int count, const char *name, gpt_part_t *part)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (gpt_find(&gpt[i], name, part) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * Load the images from raw GPT partitions found by name. The DTB and zImage
+ * headers give the sizes to read, the same way load_spi_nand() does; an
+ * initrd has no such header, so its whole partition is loaded and should be
+ * sized to it or zero padded. After the headers, all images are read
+ * together so that partitions on different cards load concurrently.
+ */
+static int load_gpt(image_info_t *image)
+{
+	gpt_t				   gpt[2];
+	int					   num_gpt = 0;
+	gpt_part_t			   dtb, kernel, initrd;
+	sdmmc_run_t			   runs[3];
+	int					   num_runs = 0;
+	linux_zimage_header_t *hdr;
+	bool				   has_initrd;
+	uint64_t			   initrd_size = 0;
+	uint32_t			   size;
+	u32					   start = time_ms();
+
+	if (gpt_read(&card0, &gpt[num_gpt], image->kernel_dest, GPT_SCRATCH_SIZE) == 0)
+		num_gpt++;
+#if CONFIG_SDMMC_CARD1
+	if (card1.online &&
+		gpt_read(&card1, &gpt[num_gpt], image->kernel_dest + GPT_SCRATCH_SIZE, GPT_SCRATCH_SIZE) == 0)
+		num_gpt++;
+#endif
+	if (num_gpt == 0)
+		return -1;
+	if (find_gpt_part(gpt, num_gpt, CONFIG_GPT_DTB_NAME, &dtb) != 0 ||
+		find_gpt_part(gpt, num_gpt, CONFIG_GPT_KERNEL_NAME, &kernel) != 0) {
+		error("GPT: no \"%s\" and \"%s\" partitions\r\n", CONFIG_GPT_DTB_NAME, CONFIG_GPT_KERNEL_NAME);
+		return -1;
+	}
+	has_initrd = strlen(CONFIG_GPT_INITRD_NAME) && find_gpt_part(gpt, num_gpt, CONFIG_GPT_INITRD_NAME, &initrd) == 0;
+
+	if (read_gpt_part(&dtb, CONFIG_GPT_DTB_NAME, image->dtb_dest, sizeof(boot_param_header_t)) != 0)
+		return -1;
+	if (fdt_check_blob_valid(image->dtb_dest) != 0) {
+		error("GPT: DTB verification failed\r\n");
+		return -1;
+	}
+	size = fdt_get_total_size(image->dtb_dest);
+	if (size > CONFIG_DTB_GUARD_SIZE ||
+		gpt_part_run(&dtb, CONFIG_GPT_DTB_NAME, image->dtb_dest, size, &runs[num_runs++]) != 0)
+		return -1;
+	image->dtb_size = size;
+
+	hdr = (linux_zimage_header_t *)image->kernel_dest;
+	if (read_gpt_part(&kernel, CONFIG_GPT_KERNEL_NAME, image->kernel_dest, sizeof(linux_zimage_header_t)) != 0)
+		return -1;
+	if (hdr->magic != LINUX_ZIMAGE_MAGIC) {
+		error("GPT: zImage verification failed\r\n");
+		return -1;
+	}
+	size = hdr->end - hdr->start;
+	if (size > (uint32_t)(image->dtb_dest - image->kernel_dest)) {
+		error("GPT: %s would overlap the DTB\r\n", CONFIG_GPT_KERNEL_NAME);
+		return -1;
+	}
+	if (gpt_part_run(&kernel, CONFIG_GPT_KERNEL_NAME, image->kernel_dest, size, &runs[num_runs++]) != 0)
+		return -1;
+	image->kernel_size = size;
+
+	if (has_initrd) {
+		initrd_size = (initrd.last_lba - initrd.first_lba + 1) * 512;
+		if (initrd_size > CONFIG_INITRAMFS_MAX_SIZE) {
+			error("GPT: %s partition larger than %" PRIu32 " bytes\r\n", CONFIG_GPT_INITRD_NAME,
+				  (uint32_t)CONFIG_INITRAMFS_MAX_SIZE);
+			return -1;
+		}
+		// Right below the DTB, clear of it and of the PSCI reserve above
+		image->initrd_dest = (uint8_t *)(((uintptr_t)image->dtb_dest - (uintptr_t)initrd_size) &
+										 ~(uintptr_t)(CONFIG_INITRD_ALIGNMENT - 1));
+		if (image->initrd_dest < image->kernel_dest + image->kernel_size) {
+			error("GPT: %s would overlap the kernel\r\n", CONFIG_GPT_INITRD_NAME);
+			image->initrd_dest = NULL;
+			return -1;
+		}
+		if (gpt_part_run(&initrd, CONFIG_GPT_INITRD_NAME, image->initrd_dest, (uint32_t)initrd_size,
+						 &runs[num_runs++]) != 0) {
+			image->initrd_dest = NULL;
+			return -1;
+		}
+	}
+
+	if (sdmmc_read_runs(runs, num_runs) != 0) {
+		error("GPT: image read failed\r\n");
+		image->initrd_dest = NULL;
+		return -1;
+	}
+	if (has_initrd)
+		image->initrd_size = (uint32_t)initrd_size;
+
+	info("GPT: loaded %s, %s%s%s in %" PRIu32 "ms\r\n", CONFIG_GPT_DTB_NAME, CONFIG_GPT_KERNEL_NAME,
+		 has_initrd ? ", " : "", has_initrd ? CONFIG_GPT_INITRD_NAME : "", time_ms() - start);
+	return 0;
+}
+#endif
+
+#if CONFIG_FAT_BOOT_INDEX
+static uint8_t	 bootidx_buf[BOOTIDX_BLOCK_LEN] __attribute__((aligned(64)));
+static bootidx_t bootidx __attribute__((aligned(64)));
+
+static const uint8_t bootidx_basic_data[16] = {0xa2, 0xa0, 0xd0, 0xeb, 0xe5, 0xb9, 0x33, 0x44,
+											   0x87, 0xc0, 0x68, 0xb6, 0xb7, 0x26, 0x99, 0xc7};
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static bool bootidx_read(uint32_t lba, void *buf)
+{
+	return sdmmc_blk_read(&card0, buf, lba, 1) == 1;
+}
+
+/* Reads a sector into bootidx_buf and tells whether it is a FAT or exFAT VBR, as check_fs() in ff.c does */
+static bool bootidx_read_vbr(uint32_t lba)
+{
+	const uint8_t *bs = bootidx_buf;
+	bool		   sign;
+
+	if (!bootidx_read(lba, bootidx_buf))
+		return FALSE;
+	sign = get_le16(bs + 510) == 0xaa55;
+	if (sign && !memcmp(bs, "\xeb\x76\x90" "EXFAT   ", 11))
+		return TRUE;
+	if (bs[0] != 0xeb && bs[0] != 0xe9 && bs[0] != 0xe8)
+		return FALSE;
+	if (sign && !memcmp(bs + 82, "FAT32   ", 8))
+		return TRUE;
+	return get_le16(bs + 11) == BOOTIDX_BLOCK_LEN && bs[13] && !(bs[13] & (bs[13] - 1)) && get_le16(bs + 14) &&
+		   (bs[16] == 1 || bs[16] == 2) && get_le16(bs + 17) &&
+		   (get_le16(bs + 19) >= 128 || get_le32(bs + 32) >= 0x10000) && get_le16(bs + 22);
+}
+
+/*
+ * Finds the volume that FatFs mounts as "0:" the way find_volume() in ff.c
+ * does, and leaves its VBR in bootidx_buf.
+ */
+static int bootidx_find_volume(uint32_t *vol)
+{
+	uint32_t lba[4], entries_lba, num, i;
+
+	if (bootidx_read_vbr(0)) {
+		*vol = 0;
+		return 0;
+	}
+	if (get_le16(bootidx_buf + 510) != 0xaa55)
+		return -1;
+
+	if (bootidx_buf[446 + 4] == 0xee) {
+		if (!bootidx_read(1, bootidx_buf) || memcmp(bootidx_buf, "EFI PART", 8) || get_le32(bootidx_buf + 76) ||
+			get_le32(bootidx_buf + 84) != 128)
+			return -1;
+		entries_lba = get_le32(bootidx_buf + 72);
+		num			= get_le32(bootidx_buf + 80);
+		// The entry sector goes to bootidx, which is free until the index is read
+		for (i = 0; i < num; i++) {
+			const uint8_t *entry = (uint8_t *)&bootidx + (i % 4) * 128;
+
+			if (i % 4 == 0 && !bootidx_read(entries_lba + i / 4, &bootidx))
+				return -1;
+			if (memcmp(entry, bootidx_basic_data, sizeof(bootidx_basic_data)) || get_le32(entry + 36))
+				continue;
+			*vol = get_le32(entry + 32);
+			if (bootidx_read_vbr(*vol))
+				return 0;
+		}
+		return -1;
+	}
+
+	for (i = 0; i < 4; i++)
+		lba[i] = get_le32(bootidx_buf + 446 + i * 16 + 8);
+	for (i = 0; i < 4; i++) {
+		*vol = lba[i];
+		if (lba[i] && bootidx_read_vbr(lba[i]))
+			return 0;
+	}
+	return -1;
+}
+
+/* Reads the index of the volume whose VBR is in bootidx_buf, and checks that it belongs to it */
+static int bootidx_load(uint32_t vol)
+{
+	const uint8_t *bs = bootidx_buf;
+	uint32_t	   idx_lba, serial, sectors;
+	uint8_t		   fs_type;
+	int			   i;
+
+	if (!memcmp(bs + 3, "EXFAT   ", 8)) {
+		fs_type = BOOTIDX_EXFAT;
+		idx_lba = get_le32(bs + 80) - 1;
+		serial	= get_le32(bs + 100);
+		sectors = get_le32(bs + 72);
+		if (get_le32(bs + 80) <= BOOTIDX_EXFAT_BOOT)
+			return -1;
+	} else {
+		fs_type = BOOTIDX_FAT;
+		idx_lba = get_le16(bs + 14) - 1;
+		serial	= get_le32(bs + (get_le16(bs + 22) ? 39 : 67));
+		sectors = get_le16(bs + 19) ? get_le16(bs + 19) : get_le32(bs + 32);
+		if (get_le16(bs + 14) < 2)
+			return -1;
+	}
+
+	if (!bootidx_read(vol + idx_lba, &bootidx) || bootidx.magic != BOOTIDX_MAGIC) {
+		debug("BOOTIDX: no index in sector %" PRIu32 "\r\n", vol + idx_lba);
+		return -1;
+	}
+	if (bootidx.version != BOOTIDX_VERSION || bootidx_sum(&bootidx) != 0 || bootidx.files > BOOTIDX_FILES) {
+		warning("BOOTIDX: bad index\r\n");
+		return -1;
+	}
+	if (bootidx.fs_type != fs_type || bootidx.serial != serial || bootidx.sectors != sectors) {
+		warning("BOOTIDX: index written for another volume\r\n");
+		return -1;
+	}
+	for (i = 0; i < bootidx.files; i++) {
+		if (bootidx.file[i].extent + bootidx.file[i].extents > BOOTIDX_EXTENTS ||
+			bootidx.file[i].entry_off > BOOTIDX_BLOCK_LEN - 32 || bootidx.file[i].stream_off > BOOTIDX_BLOCK_LEN - 32 ||
+			bootidx.file[i].name[BOOTIDX_NAME_LEN - 1]) {
+			warning("BOOTIDX: bad index\r\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static char bootidx_lower(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/* FAT names compare without case */
+static const bootidx_file_t *bootidx_lookup(const char *path)
+{
+	const char *a, *b;
+	int			i;
+
+	while (*path == '/')
+		path++;
+	for (i = 0; i < bootidx.files; i++) {
+		a = bootidx.file[i].name;
+		b = path;
+		while (*a && bootidx_lower(*a) == bootidx_lower(*b)) {
+			a++;
+			b++;
+		}
+		if (!*a && !*b)
+			return &bootidx.file[i];
+	}
+	return NULL;
+}
+
+/* Checks the file's directory entries against the index, anything rewritten since changes one of them */
+static bool bootidx_file_valid(uint32_t vol, const bootidx_file_t *file)
+{
+	const uint8_t *e;
+
+	if (!bootidx_read(vol + file->entry_lba, bootidx_buf))
+		return FALSE;
+	e = bootidx_buf + file->entry_off;
+
+	if (bootidx.fs_type == BOOTIDX_FAT) {
+		return e[0] != 0xe5 && get_le32(e + 28) == file->size &&
+			   (((uint32_t)get_le16(e + 24) << 16) | get_le16(e + 22)) == file->mtime &&
+			   (((uint32_t)get_le16(e + 20) << 16) | get_le16(e + 26)) == file->cluster;
+	}
+
+	if (e[0] != 0x85 || get_le32(e + 12) != file->mtime)
+		return FALSE;
+	if (file->stream_lba != file->entry_lba && !bootidx_read(vol + file->stream_lba, bootidx_buf))
+		return FALSE;
+	e = bootidx_buf + file->stream_off;
+	return e[0] == 0xc0 && get_le32(e + 20) == file->cluster && get_le32(e + 24) == file->size && !get_le32(e + 28);
+}
+
+/* Reads the whole sectors of a file, the partial last sector is left to bootidx_read_tail() */
+static int bootidx_read_file(uint32_t vol, const bootidx_file_t *file, uint8_t *dest)
+{
+	const bootidx_extent_t *ext	 = &bootidx.extent[file->extent];
+	uint32_t				left = file->size / BOOTIDX_BLOCK_LEN;
+	sdmmc_run_t				runs[SDMMC_MAX_RUNS];
+	int						num_runs = 0;
+	uint16_t				i;
+
+	for (i = 0; i < file->extents && left; i++, ext++) {
+		runs[num_runs].data	  = &card0;
+		runs[num_runs].buf	  = dest;
+		runs[num_runs].blkno  = vol + ext->lba;
+		runs[num_runs].blkcnt = ext->count < left ? ext->count : left;
+		dest += runs[num_runs].blkcnt * BOOTIDX_BLOCK_LEN;
+		left -= runs[num_runs].blkcnt;
+		if (++num_runs == SDMMC_MAX_RUNS) {
+			if (sdmmc_read_runs(runs, num_runs) != 0)
+				return -1;
+			num_runs = 0;
+		}
+	}
+	if (left)
+		return -1;
+	if (num_runs && sdmmc_read_runs(runs, num_runs) != 0)
+		return -1;
+	return 0;
+}
+
+static int bootidx_read_tail(uint32_t vol, const bootidx_file_t *file, uint8_t *dest)
+{
+	const bootidx_extent_t *ext	 = &bootidx.extent[file->extent + file->extents - 1];
+	uint32_t				tail = file->size % BOOTIDX_BLOCK_LEN;
+
+	if (!tail)
+		return 0;
+	if (!file->extents || !bootidx_read(vol + ext->lba + ext->count - 1, bootidx_buf))
+		return -1;
+	memcpy(dest + file->size - tail, bootidx_buf, tail);
+	return 0;
+}
+
+/*
+ * Load the images by LBA from the extents that tools/mkbootidx recorded,
+ * without mounting the volume. Any mismatch between the index and the
+ * directory entries makes load_sdmmc() fall back to FatFs.
+ */
+static int load_bootidx(image_info_t *image)
+{
+	const char			 *names[3] = {image->of_filename, image->filename, NULL};
+	uint8_t				 *dests[3] = {image->dtb_dest, image->kernel_dest, image->initrd_dest};
+	const bootidx_file_t *files[3];
+	int					  num = 2, i;
+	uint32_t			  vol;
+	u32					  start = time_ms();
+
+	if (image->initrd_filename && image->initrd_dest && strlen(image->initrd_filename)) {
+		names[2] = image->initrd_filename;
+		num		 = 3;
+	}
+
+	if (bootidx_find_volume(&vol) != 0 || bootidx_load(vol) != 0)
+		return -1;
+	for (i = 0; i < num; i++) {
+		files[i] = bootidx_lookup(names[i]);
+		if (!files[i]) {
+			info("BOOTIDX: %s not indexed\r\n", names[i]);
+			return -1;
+		}
+		if (!bootidx_file_valid(vol, files[i])) {
+			warning("BOOTIDX: %s changed since the index was written\r\n", names[i]);
+			return -1;
+		}
+	}
+
+	// Nothing is read until every file fits where it is going
+	if (files[0]->size > CONFIG_DTB_GUARD_SIZE ||
+		files[1]->size > (uint32_t)(image->dtb_dest - image->kernel_dest) ||
+		(num == 3 && files[2]->size > CONFIG_INITRAMFS_MAX_SIZE)) {
+		error("BOOTIDX: indexed file too large for its load address\r\n");
+		return -1;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (bootidx_read_file(vol, files[i], dests[i]) != 0 || bootidx_read_tail(vol, files[i], dests[i]) != 0) {
+			error("BOOTIDX: %s read failed\r\n", names[i]);
+			return -1;
+		}
+		debug("BOOTIDX: %s, %" PRIu32 " bytes in %u extents\r\n", names[i], files[i]->size,
+			  (unsigned int)files[i]->extents);
+	}
+
+	image->dtb_size	   = files[0]->size;
+	image->kernel_size = files[1]->size;
+	if (num == 3)
+		image->initrd_size = files[2]->size;
+
+	info("BOOTIDX: loaded %d files in %" PRIu32 "ms\r\n", num, time_ms() - start);
+	return 0;
+}
+#endif
+
 int load_sdmmc(image_info_t *image)
 {
 	int ret;
 
+#if CONFIG_SDMMC_GPT_BOOT
+	if (load_gpt(image) == 0)
+		return 0;
+	warning("GPT: raw images not found, trying FAT\r\n");
+#endif
+#if CONFIG_FAT_BOOT_INDEX
+	if (load_bootidx(image) == 0)
+		return 0;
+#endif
+#if CONFIG_SDMMC_GPT_BOOT || CONFIG_FAT_BOOT_INDEX
+	if (!fs_mounted && mount_fat() != 0)
+		return -1;
+#endif
+
 #if LOG_LEVEL >= LOG_DEBUG
 	u32 start;
 	start = time_ms();
@@ -203,8 +756,154 @@ int load_sdmmc(image_info_t *image)
 	debug("FATFS: done in %" PRIu32 "ms\r\n", time_ms() - start);
 #endif
 
+#if CONFIG_BLOCK_TRACE
+	disk_trace_save();
+#endif
+	return 0;
+}
+
+#if CONFIG_BOOT_MMC && CONFIG_MMC_BOOT_PART
+static uint8_t bootpart_buf[BOOTPART_BLOCK_LEN] __attribute__((aligned(64)));
+
+/* The whole blocks of an image as a read run, they go straight to the destination */
+static int bootpart_run(const bootpart_header_t *hdr, int idx, uint8_t *dest, uint32_t part_blocks, sdmmc_run_t *run)
+{
+	uint32_t offset = hdr->image[idx].offset;
+	uint32_t size	= hdr->image[idx].size;
+	uint32_t blocks = (size + BOOTPART_BLOCK_LEN - 1) / BOOTPART_BLOCK_LEN;
+
+	if (offset == 0 || offset > part_blocks || blocks > part_blocks - offset) {
+		error("BOOTPART: image %d outside the partition\r\n", idx);
+		return -1;
+	}
+
+	run->data	= &card0;
+	run->buf	= dest;
+	run->blkno	= offset;
+	run->blkcnt = size / BOOTPART_BLOCK_LEN;
 	return 0;
 }
+
+/* Only the partial last block is bounced */
+static int read_bootpart_tail(const bootpart_header_t *hdr, int idx, uint8_t *dest)
+{
+	uint32_t size = hdr->image[idx].size;
+	uint32_t tail = size % BOOTPART_BLOCK_LEN;
+
+	if (!tail)
+		return 0;
+	if (sdmmc_blk_read(&card0, bootpart_buf, hdr->image[idx].offset + size / BOOTPART_BLOCK_LEN, 1) != 1)
+		return -1;
+	memcpy(dest + size - tail, bootpart_buf, tail);
+	return 0;
+}
+
+static int load_bootpart(image_info_t *image, uint8_t part)
+{
+	bootpart_header_t	   hdr;
+	linux_zimage_header_t *zimage;
+	uint32_t			   part_blocks = sdmmc_part_blocks(&card0, part);
+	uint32_t			   initrd_size;
+	uint8_t				  *initrd_dest;
+	sdmmc_run_t			   runs[BOOTPART_IMAGES];
+
+	image->initrd_dest = NULL;
+	image->initrd_size = 0;
+
+	if (part_blocks == 0 || !sdmmc_select_part(&card0, part))
+		return -1;
+	if (sdmmc_blk_read(&card0, bootpart_buf, 0, 1) != 1)
+		return -1;
+
+	memcpy(&hdr, bootpart_buf, sizeof(hdr));
+	if (hdr.magic != BOOTPART_MAGIC || hdr.version != BOOTPART_VERSION || bootpart_sum(&hdr) != 0) {
+		debug("BOOTPART: no valid header on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+
+	initrd_size = hdr.image[BOOTPART_INITRD].size;
+	if (!hdr.image[BOOTPART_DTB].size || hdr.image[BOOTPART_DTB].size > CONFIG_DTB_GUARD_SIZE ||
+		!hdr.image[BOOTPART_KERNEL].size || initrd_size > CONFIG_INITRAMFS_MAX_SIZE) {
+		error("BOOTPART: bad image sizes on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+
+	// The initrd goes right below the DTB so it never overlaps it or the PSCI reserve above
+	initrd_dest = (uint8_t *)(((uintptr_t)image->dtb_dest - initrd_size) & ~(uintptr_t)(CONFIG_INITRD_ALIGNMENT - 1));
+	if (hdr.image[BOOTPART_KERNEL].size > (uint32_t)(image->dtb_dest - image->kernel_dest)) {
+		error("BOOTPART: kernel would overlap the DTB on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+	if (initrd_size && initrd_dest < image->kernel_dest + hdr.image[BOOTPART_KERNEL].size) {
+		error("BOOTPART: initrd would overlap the kernel on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+	if (bootpart_run(&hdr, BOOTPART_DTB, image->dtb_dest, part_blocks, &runs[0]) != 0 ||
+		bootpart_run(&hdr, BOOTPART_KERNEL, image->kernel_dest, part_blocks, &runs[1]) != 0 ||
+		(initrd_size && bootpart_run(&hdr, BOOTPART_INITRD, initrd_dest, part_blocks, &runs[2]) != 0))
+		return -1;
+
+	// All images in one go, an eMMC with a command queue gets them as separate tasks
+	if (sdmmc_read_runs(runs, initrd_size ? 3 : 2) != 0 ||
+		read_bootpart_tail(&hdr, BOOTPART_DTB, image->dtb_dest) != 0 ||
+		read_bootpart_tail(&hdr, BOOTPART_KERNEL, image->kernel_dest) != 0 ||
+		(initrd_size && read_bootpart_tail(&hdr, BOOTPART_INITRD, initrd_dest) != 0)) {
+		error("BOOTPART: read failed on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+
+	if (fdt_check_blob_valid(image->dtb_dest) != 0) {
+		error("BOOTPART: DTB verification failed on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+	image->dtb_size = hdr.image[BOOTPART_DTB].size;
+
+	zimage = (linux_zimage_header_t *)image->kernel_dest;
+	if (zimage->magic != LINUX_ZIMAGE_MAGIC) {
+		error("BOOTPART: zImage verification failed on boot%u\r\n", part - MMC_PART_BOOT0);
+		return -1;
+	}
+	image->kernel_size = hdr.image[BOOTPART_KERNEL].size;
+
+	if (initrd_size) {
+		image->initrd_dest = initrd_dest;
+		image->initrd_size = initrd_size;
+	}
+
+	return 0;
+}
+
+/*
+ * Load the images straight from an eMMC boot partition, no filesystem
+ * involved. The partition enabled for boot in PARTITION_CONFIG is tried
+ * first and the other one is the fallback, which makes boot0/boot1 an A/B
+ * pair. The user area is selected again before returning.
+ */
+int load_emmc_bootpart(image_info_t *image)
+{
+	uint8_t parts[2];
+	u32		start = time_ms();
+	int		ret	  = -1;
+	int		i;
+
+	parts[0] = sdmmc_boot_part(&card0);
+	parts[1] = parts[0] == MMC_PART_BOOT0 ? MMC_PART_BOOT1 : MMC_PART_BOOT0;
+
+	for (i = 0; i < 2 && ret != 0; i++) {
+		ret = load_bootpart(image, parts[i]);
+		if (ret == 0)
+			info("BOOTPART: loaded from boot%u in %" PRIu32 "ms\r\n", parts[i] - MMC_PART_BOOT0, time_ms() - start);
+	}
+
+	if (!sdmmc_select_part(&card0, MMC_PART_USER))
+		ret = -1;
+	if (ret != 0) {
+		image->initrd_dest = NULL;
+		image->initrd_size = 0;
+	}
+	return ret;
+}
+#endif
 #endif
 
 #if CONFIG_BOOT_SPINAND
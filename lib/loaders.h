@@ -7,8 +7,12 @@
 int	 mount_sdmmc(void);
 void unmount_sdmmc(void);
 int	 read_file(const char *filename, uint8_t *dest);
+FRESULT read_stream(const char *path, void (*consume)(const uint8_t *, UINT));
 int	 load_sdmmc(image_info_t *image);
-void sdmmc_speed_test(void);
+#endif
+
+#if CONFIG_BOOT_MMC && CONFIG_MMC_BOOT_PART
+int load_emmc_bootpart(image_info_t *image);
 #endif
 
 #if CONFIG_BOOT_SPINAND
@@ -10,7 +10,9 @@
 #include "board.h"
 #include "barrier.h"
 #include "loaders.h"
+#include "bench.h"
 #include "sunxi_dma.h"
+#include "mmu.h"
 #include <asm/armv7.h>
 #include <psci.h>
 #include <asm/secure.h>
@@ -140,7 +142,8 @@ int main(void)
 	uint32_t	 memory_size;
 
 #if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
-	bool	 sd_boot_ready = false;
+	bool	 sd_boot_ready	 = false;
+	bool	 bootpart_loaded = false;
 #endif
 
 #if CONFIG_BOOT_SPINAND
@@ -157,9 +160,32 @@ int main(void)
 		warning("CLK: init timeout at 0x%08" PRIx32 "\r\n", clk_fail);
 	}
 
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+	// Only registers and GPIOs, DRAM is not needed yet
+	debug("SMHC: init start\r\n");
+	if (sunxi_sdhci_init(&SDHCI) != 0) {
+		fatal("SMHC: %s controller init failed\r\n", SDHCI.name);
+	}
+#if CONFIG_SDMMC_CARD1
+	if (sunxi_sdhci_init(&SDHCI_CARD1) != 0) {
+		fatal("SMHC: %s controller init failed\r\n", SDHCI_CARD1.name);
+	}
+#endif
+#if CONFIG_SDMMC_EARLY_START
+	// The card's power-up is mostly waiting, let it run between the DRAM init steps
+	sdmmc_early_start(&card0, &SDHCI);
+#if CONFIG_SDMMC_CARD1
+	sdmmc_early_start(&card1, &SDHCI_CARD1);
+#endif
+#endif
+#endif
+
 	memory_size = sunxi_dram_init();
 	info("DRAM init done: %" PRIu32 " MiB\r\n", memory_size >> 20);
 
+	// Everything from here on copies images around DRAM, run it cached
+	sunxi_mmu_enable(memory_size);
+
 #ifdef CONFIG_ENABLE_CPU_FREQ_DUMP
 	sunxi_clk_dump();
 #endif
@@ -176,11 +202,11 @@ int main(void)
 // Normal media boot
 #if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
 
-	debug("SMHC: init start\r\n");
-	if (sunxi_sdhci_init(&SDHCI) != 0) {
-		fatal("SMHC: %s controller init failed\r\n", SDHCI.name);
-	}
 	info("SMHC: detect start\r\n");
+#if CONFIG_SDMMC_CARD1
+	if (sdmmc_init(&card1, &SDHCI_CARD1) != 0)
+		warning("SMHC: %s init failed, card1 unavailable\r\n", SDHCI_CARD1.name);
+#endif
 	if (sdmmc_init(&card0, &SDHCI) != 0) {
 #if CONFIG_BOOT_SPINAND
 		warning("SMHC: init failed, trying SPI\r\n");
@@ -189,17 +215,29 @@ int main(void)
 		fatal("SMHC: init failed\r\n");
 #endif
 	} else {
-		sdmmc_speed_test();
-		info("SMHC: mount start\r\n");
-		if (mount_sdmmc() != 0) {
-			fatal("SMHC: card mount failed\r\n");
+#if CONFIG_STORAGE_BENCH
+		storage_bench();
+#endif
+#if CONFIG_BOOT_MMC && CONFIG_MMC_BOOT_PART
+		bootpart_loaded = (load_emmc_bootpart(&image) == 0);
+		if (!bootpart_loaded)
+			info("BOOTPART: no bootable eMMC boot partition, using FAT\r\n");
+#endif
+		if (!bootpart_loaded) {
+			info("SMHC: mount start\r\n");
+			if (mount_sdmmc() != 0) {
+				fatal("SMHC: card mount failed\r\n");
+			}
+
+			image.initrd_size = 0; // Set by load_sdmmc()
+			sd_boot_ready	  = true;
 		}
-
-		image.initrd_size = 0; // Set by load_sdmmc()
-		sd_boot_ready		  = true;
 	}
 
 #elif CONFIG_BOOT_SPINAND
+#if CONFIG_STORAGE_BENCH
+	storage_bench();
+#endif
 	// Static slot configs for SPI
 	image.initrd_size = 0; // disabled
 	strcpy(cmd_line, CONFIG_DEFAULT_BOOT_CMD);
@@ -236,6 +274,10 @@ int main(void)
 #endif
 
 #if CONFIG_BOOT_SPINAND
+#if CONFIG_BOOT_SDCARD || CONFIG_BOOT_MMC
+	if (bootpart_loaded)
+		image_loaded = true;
+#endif
 	if (!image_loaded) {
 		if (cmd_line[0] == '\0') {
 			strcpy(cmd_line, CONFIG_DEFAULT_BOOT_CMD);
@@ -324,9 +366,8 @@ int main(void)
 	info("booting linux...\r\n");
 	board_set_led(LED_BOARD, 0);
 
-	arm32_mmu_disable();
-	arm32_dcache_disable();
-	arm32_icache_disable();
+	// Write back the loaded images and FDT edits before the kernel runs uncached
+	sunxi_mmu_disable();
 	arm32_interrupt_disable();
 
 	kernel_entry = (void (*)(int, int, unsigned int))entry_point;
@@ -0,0 +1,493 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "bootidx.h"
+
+/*
+ * Writes the boot extent index of lib/bootidx.h into a FAT or exFAT volume
+ * for awboot's CONFIG_FAT_BOOT_INDEX loader. Run it on the partition (or a
+ * partition image), not the whole disk, each time the boot files change:
+ *   mkbootidx /dev/mmcblk0p1 sun8i-t113-mangopi-dual.dtb zImage
+ * A stale index is harmless, awboot notices and mounts the volume instead.
+ */
+
+#define SECTOR_LEN BOOTIDX_BLOCK_LEN
+#define DIR_ENTRY  32
+
+typedef struct {
+	FILE	*fp;
+	int		 exfat;
+	int		 fat_bits; /* 12, 16 or 32 */
+	uint32_t fat_lba;
+	uint32_t root_lba; /* FAT12/16 fixed root directory */
+	uint32_t root_sectors;
+	uint32_t root_cluster;
+	uint32_t data_lba; /* cluster 2 */
+	uint32_t cluster_sectors;
+	uint32_t clusters;
+	uint32_t serial;
+	uint32_t sectors;
+	uint32_t index_lba;
+} volume_t;
+
+typedef struct {
+	uint32_t size;
+	uint32_t mtime;
+	uint32_t cluster;
+	int		 contiguous; /* exFAT NoFatChain */
+	int		 dir;
+	uint32_t entry_lba, stream_lba;
+	uint16_t entry_off, stream_off;
+} entry_t;
+
+/* Position in a directory, one sector at a time */
+typedef struct {
+	volume_t *vol;
+	uint32_t  cluster; /* 0 for the FAT12/16 root */
+	int		  contiguous;
+	uint32_t  sector; /* in the cluster, or in the fixed root */
+	uint32_t  lba;
+	uint8_t	  buf[SECTOR_LEN];
+} dir_t;
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static int read_sectors(volume_t *vol, uint32_t lba, uint8_t *buf, uint32_t count)
+{
+	if (fseeko(vol->fp, (off_t)lba * SECTOR_LEN, SEEK_SET) != 0 ||
+		fread(buf, SECTOR_LEN, count, vol->fp) != count) {
+		printf("Read of sector %u failed\n", lba);
+		return -1;
+	}
+	return 0;
+}
+
+static uint32_t cluster_lba(volume_t *vol, uint32_t cluster)
+{
+	return vol->data_lba + (cluster - 2) * vol->cluster_sectors;
+}
+
+/* The cluster following cluster in its FAT chain, 0 at the end of the chain */
+static uint32_t next_cluster(volume_t *vol, uint32_t cluster)
+{
+	uint8_t	 buf[2 * SECTOR_LEN];
+	uint32_t offset, val;
+
+	if (cluster < 2 || cluster >= vol->clusters + 2)
+		return 0;
+
+	offset = vol->fat_bits == 12 ? cluster + cluster / 2 : cluster * (vol->fat_bits / 8);
+	if (read_sectors(vol, vol->fat_lba + offset / SECTOR_LEN, buf, 2) != 0)
+		return 0;
+	offset %= SECTOR_LEN;
+
+	if (vol->fat_bits == 12) {
+		val = get_le16(buf + offset);
+		val = (cluster & 1) ? val >> 4 : val & 0xfff;
+		return val < 0xff7 ? val : 0;
+	}
+	if (vol->fat_bits == 16) {
+		val = get_le16(buf + offset);
+		return val < 0xfff7 ? val : 0;
+	}
+	val = get_le32(buf + offset);
+	if (!vol->exfat)
+		val &= 0x0fffffff;
+	return val < 0x0ffffff7 ? val : 0;
+}
+
+static int dir_open(dir_t *dir, volume_t *vol, uint32_t cluster, int contiguous)
+{
+	dir->vol		= vol;
+	dir->cluster	= cluster;
+	dir->contiguous = contiguous;
+	dir->sector		= 0;
+	dir->lba		= cluster ? cluster_lba(vol, cluster) : vol->root_lba;
+	return read_sectors(vol, dir->lba, dir->buf, 1);
+}
+
+/* 0 with the next sector loaded, -1 at the end of the directory */
+static int dir_next(dir_t *dir)
+{
+	volume_t *vol = dir->vol;
+
+	dir->sector++;
+	if (!dir->cluster) {
+		if (dir->sector == vol->root_sectors)
+			return -1;
+	} else if (dir->sector == vol->cluster_sectors) {
+		dir->cluster = dir->contiguous ? dir->cluster + 1 : next_cluster(vol, dir->cluster);
+		if (dir->cluster < 2)
+			return -1;
+		dir->sector = 0;
+	}
+	dir->lba = dir->cluster ? cluster_lba(vol, dir->cluster) + dir->sector : vol->root_lba + dir->sector;
+	return read_sectors(vol, dir->lba, dir->buf, 1);
+}
+
+/* ASCII names compare without case, like FAT does */
+static int name_char_matches(uint16_t c, char n)
+{
+	return c < 0x80 && tolower(c) == tolower((unsigned char)n);
+}
+
+static int utf16_matches(const uint16_t *name, int len, const char *want, int want_len)
+{
+	int i;
+
+	if (len != want_len)
+		return 0;
+	for (i = 0; i < len; i++) {
+		if (!name_char_matches(name[i], want[i]))
+			return 0;
+	}
+	return 1;
+}
+
+static int sfn_matches(const uint8_t *entry, const char *want, int want_len)
+{
+	char name[13];
+	int	 i, len = 0;
+
+	for (i = 0; i < 8 && entry[i] != ' '; i++)
+		name[len++] = entry[i];
+	if (entry[8] != ' ') {
+		name[len++] = '.';
+		for (i = 8; i < 11 && entry[i] != ' '; i++)
+			name[len++] = entry[i];
+	}
+	if (len != want_len)
+		return 0;
+	for (i = 0; i < len; i++) {
+		if (!name_char_matches((uint8_t)name[i], want[i]))
+			return 0;
+	}
+	return 1;
+}
+
+static int fat_find(volume_t *vol, uint32_t cluster, const char *want, int want_len, entry_t *found)
+{
+	static const int lfn_offsets[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+	dir_t			 dir;
+	uint16_t		 lfn[260];
+	int				 lfn_len = 0, off, i, ord;
+	uint8_t			*e;
+
+	if (dir_open(&dir, vol, cluster, 0) != 0)
+		return -1;
+	do {
+		for (off = 0; off < SECTOR_LEN; off += DIR_ENTRY) {
+			e = dir.buf + off;
+			if (e[0] == 0x00)
+				return -1;
+			if (e[0] == 0xe5) {
+				lfn_len = 0;
+				continue;
+			}
+			if (e[11] == 0x0f) {
+				ord = e[0] & 0x3f;
+				if (ord == 0 || ord > 20)
+					continue;
+				if (e[0] & 0x40)
+					lfn_len = 0;
+				for (i = 0; i < 13; i++) {
+					uint16_t c = get_le16(e + lfn_offsets[i]);
+
+					if (c == 0x0000 || c == 0xffff)
+						break;
+					lfn[(ord - 1) * 13 + i] = c;
+					if ((ord - 1) * 13 + i + 1 > lfn_len)
+						lfn_len = (ord - 1) * 13 + i + 1;
+				}
+				continue;
+			}
+			if (!(e[11] & 0x08) &&
+				(lfn_len ? utf16_matches(lfn, lfn_len, want, want_len) : sfn_matches(e, want, want_len))) {
+				found->size		  = get_le32(e + 28);
+				found->mtime	  = ((uint32_t)get_le16(e + 24) << 16) | get_le16(e + 22);
+				found->cluster	  = ((uint32_t)get_le16(e + 20) << 16) | get_le16(e + 26);
+				found->contiguous = 0;
+				found->dir		  = !!(e[11] & 0x10);
+				found->entry_lba = found->stream_lba = dir.lba;
+				found->entry_off = found->stream_off = off;
+				return 0;
+			}
+			lfn_len = 0;
+		}
+	} while (dir_next(&dir) == 0);
+	return -1;
+}
+
+static int exfat_find(volume_t *vol, uint32_t cluster, int contiguous, const char *want, int want_len,
+					  entry_t *found)
+{
+	dir_t	 dir;
+	uint16_t name[255];
+	int		 name_len = 0, left = 0, off, i;
+	uint8_t *e;
+
+	if (dir_open(&dir, vol, cluster, contiguous) != 0)
+		return -1;
+	do {
+		for (off = 0; off < SECTOR_LEN; off += DIR_ENTRY) {
+			e = dir.buf + off;
+			if (e[0] == 0x00)
+				return -1;
+			if (e[0] == 0x85) { // File
+				left			 = e[1];
+				name_len		 = 0;
+				found->mtime	 = get_le32(e + 12);
+				found->dir		 = !!(get_le16(e + 4) & 0x10);
+				found->entry_lba = dir.lba;
+				found->entry_off = off;
+				continue;
+			}
+			if (!left)
+				continue;
+			left--;
+			if (e[0] == 0xc0) { // Stream extension
+				found->contiguous = !!(e[1] & 0x02);
+				found->cluster	  = get_le32(e + 20);
+				found->size		  = get_le32(e + 24);
+				found->stream_lba = dir.lba;
+				found->stream_off = off;
+				if (get_le32(e + 28)) {
+					left = 0; // over 4GB, not a boot file
+					continue;
+				}
+			} else if (e[0] == 0xc1) { // File name
+				for (i = 0; i < 15 && name_len < 255; i++)
+					name[name_len++] = get_le16(e + 2 + i * 2);
+			}
+			if (!left) {
+				while (name_len && name[name_len - 1] == 0)
+					name_len--;
+				if (utf16_matches(name, name_len, want, want_len))
+					return 0;
+			}
+		}
+	} while (dir_next(&dir) == 0);
+	return -1;
+}
+
+static int find_path(volume_t *vol, const char *path, entry_t *found)
+{
+	uint32_t	cluster	   = vol->root_cluster;
+	int			contiguous = 0;
+	const char *end;
+	int			ret;
+
+	while (*path == '/')
+		path++;
+	if (!*path)
+		return -1;
+	while (*path) {
+		end = strchr(path, '/');
+		if (!end)
+			end = path + strlen(path);
+		if (vol->exfat)
+			ret = exfat_find(vol, cluster, contiguous, path, end - path, found);
+		else
+			ret = fat_find(vol, cluster, path, end - path, found);
+		if (ret != 0)
+			return -1;
+
+		while (*end == '/')
+			end++;
+		if (*end && !found->dir)
+			return -1;
+		cluster	   = found->cluster;
+		contiguous = found->contiguous;
+		path	   = end;
+	}
+	return found->dir ? -1 : 0;
+}
+
+/* Appends the file's sectors to the index as runs of consecutive sectors */
+static int add_extents(volume_t *vol, const entry_t *e, bootidx_t *idx, int *used, bootidx_file_t *file)
+{
+	uint32_t		  need	  = (e->size + SECTOR_LEN - 1) / SECTOR_LEN;
+	uint32_t		  cluster = e->cluster;
+	uint32_t		  lba, count;
+	bootidx_extent_t *ext = NULL;
+
+	file->extent  = *used;
+	file->extents = 0;
+	while (need) {
+		if (cluster < 2 || cluster >= vol->clusters + 2) {
+			printf("%s: cluster chain ends before the end of the file\n", file->name);
+			return -1;
+		}
+		lba	  = cluster_lba(vol, cluster);
+		count = need < vol->cluster_sectors ? need : vol->cluster_sectors;
+		if (ext && ext->lba + ext->count == lba) {
+			ext->count += count;
+		} else {
+			if (*used == BOOTIDX_EXTENTS) {
+				printf("%s: too fragmented, more than %d extents in total\n", file->name, BOOTIDX_EXTENTS);
+				return -1;
+			}
+			ext		   = &idx->extent[(*used)++];
+			ext->lba   = lba;
+			ext->count = count;
+			file->extents++;
+		}
+		need -= count;
+		if (need)
+			cluster = e->contiguous ? cluster + 1 : next_cluster(vol, cluster);
+	}
+	return 0;
+}
+
+static int open_volume(volume_t *vol)
+{
+	uint8_t	 bs[SECTOR_LEN];
+	uint32_t fat_size, rsvd;
+
+	if (read_sectors(vol, 0, bs, 1) != 0)
+		return -1;
+	if (get_le16(bs + 510) != 0xaa55) {
+		printf("No boot sector, give the partition rather than the whole disk\n");
+		return -1;
+	}
+
+	if (!memcmp(bs, "\xeb\x76\x90" "EXFAT   ", 11)) {
+		if (bs[108] != 9) {
+			printf("Only 512 byte sectors are supported\n");
+			return -1;
+		}
+		vol->exfat			 = 1;
+		vol->fat_bits		 = 32;
+		vol->fat_lba		 = get_le32(bs + 80);
+		vol->data_lba		 = get_le32(bs + 88);
+		vol->clusters		 = get_le32(bs + 92);
+		vol->root_cluster	 = get_le32(bs + 96);
+		vol->serial			 = get_le32(bs + 100);
+		vol->cluster_sectors = 1 << bs[109];
+		vol->sectors		 = get_le32(bs + 72);
+		if (vol->fat_lba <= BOOTIDX_EXFAT_BOOT) {
+			printf("No free sector between the boot regions and the FAT\n");
+			return -1;
+		}
+		vol->index_lba = vol->fat_lba - 1;
+		return 0;
+	}
+
+	if (get_le16(bs + 11) != SECTOR_LEN || !bs[13] || !bs[16]) {
+		printf("Not a FAT volume with 512 byte sectors\n");
+		return -1;
+	}
+	rsvd				 = get_le16(bs + 14);
+	fat_size			 = get_le16(bs + 22) ? get_le16(bs + 22) : get_le32(bs + 36);
+	vol->sectors		 = get_le16(bs + 19) ? get_le16(bs + 19) : get_le32(bs + 32);
+	vol->cluster_sectors = bs[13];
+	vol->fat_lba		 = rsvd;
+	vol->root_lba		 = rsvd + bs[16] * fat_size;
+	vol->root_sectors	 = (get_le16(bs + 17) * DIR_ENTRY + SECTOR_LEN - 1) / SECTOR_LEN;
+	vol->data_lba		 = vol->root_lba + vol->root_sectors;
+	vol->clusters		 = (vol->sectors - vol->data_lba) / vol->cluster_sectors;
+	vol->fat_bits		 = vol->clusters <= 0xff5 ? 12 : vol->clusters <= 0xfff5 ? 16 : 32;
+	vol->root_cluster	 = vol->fat_bits == 32 ? get_le32(bs + 44) : 0;
+	vol->serial			 = get_le32(bs + (get_le16(bs + 22) ? 39 : 67));
+	if (rsvd < 2) {
+		printf("No reserved sector after the boot sector, format with e.g. mkfs.fat -R 8\n");
+		return -1;
+	}
+	vol->index_lba = rsvd - 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	volume_t  vol = {0};
+	bootidx_t idx, old;
+	entry_t	  e = {0};
+	int		  used = 0;
+	int		  i;
+
+	if (argc < 3 || argc > 2 + BOOTIDX_FILES) {
+		printf("Usage: mkbootidx <FAT/exFAT partition> <file> [file] [file]\n");
+		return -1;
+	}
+
+	vol.fp = fopen(argv[1], "r+b");
+	if (vol.fp == NULL) {
+		printf("Open file '%s' error\n", argv[1]);
+		return -1;
+	}
+	if (open_volume(&vol) != 0)
+		return -1;
+
+	memset(&idx, 0, sizeof(idx));
+	idx.magic	= BOOTIDX_MAGIC;
+	idx.version = BOOTIDX_VERSION;
+	idx.serial	= vol.serial;
+	idx.sectors = vol.sectors;
+	idx.fs_type = vol.exfat ? BOOTIDX_EXFAT : BOOTIDX_FAT;
+
+	for (i = 0; i + 2 < argc; i++) {
+		bootidx_file_t *file = &idx.file[i];
+		const char	   *path = argv[i + 2];
+
+		while (*path == '/')
+			path++;
+		if (strlen(path) >= BOOTIDX_NAME_LEN) {
+			printf("%s: name longer than %d characters\n", path, BOOTIDX_NAME_LEN - 1);
+			return -1;
+		}
+		strcpy(file->name, path);
+		if (find_path(&vol, path, &e) != 0) {
+			printf("%s: not found\n", path);
+			return -1;
+		}
+
+		file->size		 = e.size;
+		file->mtime		 = e.mtime;
+		file->cluster	 = e.cluster;
+		file->entry_lba	 = e.entry_lba;
+		file->entry_off	 = e.entry_off;
+		file->stream_lba = e.stream_lba;
+		file->stream_off = e.stream_off;
+		if (add_extents(&vol, &e, &idx, &used, file) != 0)
+			return -1;
+		idx.files++;
+		printf("%-32s %9u bytes in %u extent(s)\n", file->name, file->size, file->extents);
+	}
+	idx.checksum = -bootidx_sum(&idx);
+
+	/* Only overwrite an empty sector or an older index */
+	if (read_sectors(&vol, vol.index_lba, (uint8_t *)&old, 1) != 0)
+		return -1;
+	if (old.magic != BOOTIDX_MAGIC) {
+		for (i = 0; i < SECTOR_LEN && !((uint8_t *)&old)[i]; i++) {
+		}
+		if (i < SECTOR_LEN) {
+			printf("Sector %u is in use, not writing the index\n", vol.index_lba);
+			return -1;
+		}
+	}
+
+	if (fseeko(vol.fp, (off_t)vol.index_lba * SECTOR_LEN, SEEK_SET) != 0 ||
+		fwrite(&idx, sizeof(idx), 1, vol.fp) != 1) {
+		printf("Write of sector %u failed\n", vol.index_lba);
+		return -1;
+	}
+	fclose(vol.fp);
+
+	printf("%s: index of %u files in sector %u (%s)\n", argv[1], idx.files, vol.index_lba,
+		   vol.exfat ? "exFAT" : vol.fat_bits == 32 ? "FAT32" : vol.fat_bits == 16 ? "FAT16" : "FAT12");
+	return 0;
+}
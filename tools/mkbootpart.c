@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bootpart.h"
+
+/*
+ * Builds an eMMC boot partition image for awboot's CONFIG_MMC_BOOT_PART
+ * loader: the header in block 0, then the DTB, zImage and optional initrd,
+ * each starting on a 4KB boundary. Write it with e.g.
+ *   echo 0 > /sys/block/mmcblk0boot0/force_ro
+ *   dd if=boot.part of=/dev/mmcblk0boot0
+ */
+
+#define IMAGE_ALIGN_BLOCKS 8 /* 4KB */
+
+static char *read_all(const char *path, uint32_t *size)
+{
+	FILE *fp;
+	char *buf;
+	long  len;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("Open file '%s' error\n", path);
+		return NULL;
+	}
+
+	fseek(fp, 0L, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	buf = malloc(len > 0 ? len : 1);
+	if (buf == NULL || fread(buf, 1, len, fp) != (size_t)len) {
+		printf("Read file '%s' error\n", path);
+		free(buf);
+		fclose(fp);
+		return NULL;
+	}
+
+	fclose(fp);
+	*size = (uint32_t)len;
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	bootpart_header_t hdr;
+	const char		 *names[BOOTPART_IMAGES] = {"dtb", "zImage", "initrd"};
+	char			 *data[BOOTPART_IMAGES]	 = {NULL};
+	uint32_t		  block = 1;
+	FILE			 *fp;
+	int				  i;
+
+	if (argc < 4 || argc > 5) {
+		printf("Usage: mkbootpart <output> <dtb> <zImage> [initrd]\n");
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic	= BOOTPART_MAGIC;
+	hdr.version = BOOTPART_VERSION;
+
+	for (i = 0; i < BOOTPART_IMAGES && i + 2 < argc; i++) {
+		data[i] = read_all(argv[i + 2], &hdr.image[i].size);
+		if (data[i] == NULL)
+			return -1;
+
+		block				  = (block + IMAGE_ALIGN_BLOCKS - 1) / IMAGE_ALIGN_BLOCKS * IMAGE_ALIGN_BLOCKS;
+		hdr.image[i].offset = block;
+		block += (hdr.image[i].size + BOOTPART_BLOCK_LEN - 1) / BOOTPART_BLOCK_LEN;
+		printf("%-6s %8u bytes at block %u\n", names[i], hdr.image[i].size, hdr.image[i].offset);
+	}
+	hdr.checksum = -bootpart_sum(&hdr);
+
+	fp = fopen(argv[1], "wb");
+	if (fp == NULL) {
+		printf("Open file '%s' error\n", argv[1]);
+		return -1;
+	}
+
+	fwrite(&hdr, 1, sizeof(hdr), fp);
+	for (i = 0; i < BOOTPART_IMAGES; i++) {
+		if (data[i] == NULL)
+			continue;
+		fseek(fp, (long)hdr.image[i].offset * BOOTPART_BLOCK_LEN, SEEK_SET);
+		fwrite(data[i], 1, hdr.image[i].size, fp);
+		free(data[i]);
+	}
+
+	/* Pad to a whole block so dd writes the tail */
+	fseek(fp, (long)block * BOOTPART_BLOCK_LEN - 1, SEEK_SET);
+	fputc(0, fp);
+	fclose(fp);
+
+	printf("%s: %u blocks (%u KB)\n", argv[1], block, block / 2);
+	return 0;
+}